@@ -26,12 +26,17 @@
 #include <winhttp.h>
 #include <fstream>
 #include <vector>
+#include <cstdint>
 #include <string>
 #include <map>
+#include <array>
+#include <deque>
+#include <unordered_map>
 #include <algorithm>
 #include <chrono>
 #include <stdexcept>
 #include <numeric>
+#include <limits>
 #include <cmath>
 #include <clocale>
 #include <sstream>
@@ -40,6 +45,14 @@
 #include <wininet.h>
 #include <future>
 #include <mutex>
+#include <immintrin.h>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <type_traits>
 #pragma comment(lib, "wininet.lib")
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "dxgi.lib")
@@ -54,6 +67,76 @@ constexpr double PI = 3.14159265358979323846;
 constexpr double PI = M_PI;
 #endif
 
+// Jądra wektorowe: SSE2 jest częścią bazowego zestawu x64, jądra AVX2 kompilowane są dla AVX2
+// niezależnie od ustawień projektu (bez /arch:AVX2) i wybierane w czasie działania przez ActiveSimd().
+// MSVC dopuszcza intrynsyki AVX2 w każdej funkcji, GCC/Clang wymagają atrybutu target.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AQI_SSE2 1
+#endif
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AQI_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AQI_TARGET_AVX2
+#else
+#define AQI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+//******************************************************************************************
+// Wykrywanie instrukcji wektorowych
+//******************************************************************************************
+
+/// Poziom instrukcji wektorowych używany przez jądra obliczeniowe
+enum class SimdLevel { Scalar, Sse2, Avx2 };
+
+/// Najwyższy poziom obsługiwany przez procesor i system: AVX2 wymaga bitu CPUID.7:EBX[5] oraz
+/// zapisywania rejestrów YMM przez system (OSXSAVE i XCR0 bity 1–2). Wykrywany raz.
+SimdLevel DetectSimd() {
+    static const SimdLevel level = [] {
+#if defined(AQI_X86) && defined(_MSC_VER)
+        int r[4];
+        __cpuid(r, 0);
+        const int maxLeaf = r[0];
+        __cpuid(r, 1);
+        const bool sse2 = (r[3] >> 26) & 1, osxsave = (r[2] >> 27) & 1, avx = (r[2] >> 28) & 1;
+        if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(r, 7, 0);
+            if ((r[1] >> 5) & 1) return SimdLevel::Avx2;
+        }
+        return sse2 ? SimdLevel::Sse2 : SimdLevel::Scalar;
+#elif defined(AQI_X86)
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::Avx2;
+        return __builtin_cpu_supports("sse2") ? SimdLevel::Sse2 : SimdLevel::Scalar;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }();
+    return level;
+}
+
+static std::atomic<int> simdLimit{ static_cast<int>(SimdLevel::Avx2) };
+
+/// Ogranicza poziom używany przez jądra (autotesty i pomiary sprawdzają każdą ścieżkę)
+void SetSimdLimit(SimdLevel limit) {
+    simdLimit = static_cast<int>(limit);
+}
+
+/// Poziom używany przez jądra: wykryty, nie wyższy niż ustawiony przez SetSimdLimit
+SimdLevel ActiveSimd() {
+    return static_cast<SimdLevel>(std::min(static_cast<int>(DetectSimd()), simdLimit.load(std::memory_order_relaxed)));
+}
+
+const char* SimdName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Avx2: return "AVX2";
+    case SimdLevel::Sse2: return "SSE2";
+    default: return "skalarne";
+    }
+}
+
 
 
 //******************************************************************************************
@@ -68,17 +151,379 @@ struct Sensor {
     std::string name;
 };
 
+/// Seria pomiarów jednego sensora (czas, wartość), posortowana rosnąco po czasie
+using Series = std::vector<std::pair<system_clock::time_point, double>>;
+
+/// Widok fragmentu serii kolumnowej – wskaźniki do ciągłych tablic, bez kopiowania
+struct SeriesView {
+    const int64_t* ts = nullptr;
+    const double* values = nullptr;
+    size_t size = 0;
+
+    bool empty() const { return size == 0; }
+};
+
+/// Szkic kwantyli (scalający t-digest): centroidy (średnia, waga) o rozmiarze ograniczonym funkcją skali k1,
+/// dzięki czemu ogony rozkładu (p95, p98) są odwzorowane dokładniej niż środek. Liczba centroidów jest
+/// ograniczona przez parametr kompresji, więc zapytanie o kwantyl ma stały koszt niezależny od liczby próbek.
+/// Szkice są scalalne: połączenie szkiców fragmentów daje szkic całości.
+/// Metody const nie modyfikują szkicu, więc skompresowany szkic można czytać z wielu wątków.
+class QuantileSketch {
+public:
+    explicit QuantileSketch(double compression = 100.0) : compression(compression) {}
+
+    /// Skompresowany szkic wartości serii
+    static QuantileSketch Of(SeriesView v) {
+        QuantileSketch out;
+        for (size_t i = 0; i < v.size; ++i)
+            out.Push(v.values[i]);
+        out.Compress();
+        return out;
+    }
+
+    size_t Count() const { return static_cast<size_t>(count); }
+    bool Empty() const { return Count() == 0; }
+
+    void Push(double x, double weight = 1.0) {
+        if (!std::isfinite(x)) return;
+        buffer.push_back({ x, weight });
+        count += weight;
+        min = std::min(min, x);
+        max = std::max(max, x);
+        if (buffer.size() >= static_cast<size_t>(compression) * 5)
+            Compress();
+    }
+
+    void Merge(const QuantileSketch& o) {
+        if (o.Empty()) return;
+        buffer.insert(buffer.end(), o.centroids.begin(), o.centroids.end());
+        buffer.insert(buffer.end(), o.buffer.begin(), o.buffer.end());
+        count += o.count;
+        min = std::min(min, o.min);
+        max = std::max(max, o.max);
+        Compress();
+    }
+
+    void Clear() {
+        centroids.clear();
+        buffer.clear();
+        total = count = 0;
+        min = std::numeric_limits<double>::infinity();
+        max = -std::numeric_limits<double>::infinity();
+    }
+
+    /// Kwantyl q z przedziału [0, 1]; NaN dla pustego szkicu.
+    /// Próbki nie scalone jeszcze przez Compress() wymagają scalenia w kopii szkicu.
+    double Quantile(double q) const {
+        if (!buffer.empty()) {
+            QuantileSketch merged(*this);
+            merged.Compress();
+            return merged.Quantile(q);
+        }
+        if (centroids.empty()) return std::nan("");
+        if (centroids.size() == 1) return centroids[0].mean;
+        q = std::clamp(q, 0.0, 1.0);
+        const double index = q * total;
+        const auto& c = centroids;
+
+        // Między minimum a środkiem pierwszego centroidu
+        if (index < c[0].weight / 2)
+            return min + (c[0].mean - min) * (index / (c[0].weight / 2));
+        double cum = c[0].weight / 2;
+        for (size_t i = 0; i + 1 < c.size(); ++i) {
+            const double dw = (c[i].weight + c[i + 1].weight) / 2;
+            if (index < cum + dw)
+                return c[i].mean + (c[i + 1].mean - c[i].mean) * ((index - cum) / dw);
+            cum += dw;
+        }
+        // Między środkiem ostatniego centroidu a maksimum
+        const double lastHalf = c.back().weight / 2;
+        const double frac = lastHalf > 0 ? std::min(1.0, (index - cum) / lastHalf) : 1.0;
+        return c.back().mean + (max - c.back().mean) * frac;
+    }
+
+    /// Scala bufor z centroidami jednym przebiegiem po posortowanych punktach
+    void Compress() {
+        if (buffer.empty()) return;
+        buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+        std::sort(buffer.begin(), buffer.end(), [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+        total = 0;
+        for (const auto& b : buffer) total += b.weight;
+
+        centroids.clear();
+        Centroid cur = buffer[0];
+        double soFar = 0;
+        double limit = QuantileLimit(0);
+        for (size_t i = 1; i < buffer.size(); ++i) {
+            const Centroid& next = buffer[i];
+            if ((soFar + cur.weight + next.weight) / total <= limit) {
+                cur.weight += next.weight;
+                cur.mean += (next.mean - cur.mean) * next.weight / cur.weight;
+            }
+            else {
+                soFar += cur.weight;
+                centroids.push_back(cur);
+                limit = QuantileLimit(soFar / total);
+                cur = next;
+            }
+        }
+        centroids.push_back(cur);
+        buffer.clear();
+    }
+
+private:
+    struct Centroid {
+        double mean, weight;
+    };
+
+    /// Górna granica kwantyla centroidu zaczynającego się w q0: k(q) = δ/(2π)·asin(2q - 1), k(koniec) = k(q0) + 1
+    double QuantileLimit(double q0) const {
+        const double k = compression / (2 * PI) * std::asin(2 * q0 - 1) + 1;
+        const double angle = k * 2 * PI / compression;
+        return angle >= PI / 2 ? 1.0 : (std::sin(angle) + 1) / 2;
+    }
+
+    double compression;
+    std::vector<Centroid> centroids;   // posortowane po średniej
+    std::vector<Centroid> buffer;      // próbki czekające na scalenie
+    double total = 0;                  // łączna waga centroidów
+    double count = 0;                          // łączna waga wszystkich próbek
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+};
+
+/// Jednoprzebiegowy akumulator statystyk serii: średnie i sumy kwadratów odchyleń metodą Welforda,
+/// współodchylenia (x, y) dla trendu liniowego oraz min/max z czasem wystąpienia.
+/// Push dodaje próbkę w O(1), więc dopisanie nowego pomiaru do serii nie wymaga ponownej analizy.
+struct OnlineStats {
+    size_t n = 0;
+    double meanX = 0, meanY = 0;
+    double m2x = 0, m2y = 0, cxy = 0;   // sumy (x - x̄)², (y - ȳ)², (x - x̄)(y - ȳ)
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    int64_t minT = 0, maxT = 0;
+
+    /// Dodaje próbkę o kolejnym numerze porządkowym (x = liczba dotychczasowych próbek)
+    void Push(int64_t t, double y) { Push(static_cast<double>(n), t, y); }
+
+    void Push(double x, int64_t t, double y) {
+        ++n;
+        const double dx = x - meanX;
+        const double dy = y - meanY;
+        meanX += dx / n;
+        meanY += dy / n;
+        m2x += dx * (x - meanX);
+        m2y += dy * (y - meanY);
+        cxy += dx * (y - meanY);
+        if (y < min) { min = y; minT = t; }
+        if (y >= max) { max = y; maxT = t; }
+    }
+
+    double Mean() const { return meanY; }
+    double Variance() const { return n > 1 ? m2y / (n - 1) : 0.0; }
+    double StdDev() const { return std::sqrt(Variance()); }
+    /// Nachylenie prostej najmniejszych kwadratów y(x)
+    double Slope() const { return m2x > 0 ? cxy / m2x : 0.0; }
+};
+
+/// Seria czasowa jednego sensora w układzie kolumnowym: równoległe tablice czasów (sekundy UTC)
+/// i wartości, posortowane rosnąco po czasie. Przycięcie od początku przesuwa jedynie indeks head,
+/// a martwy prefiks jest kompaktowany w miejscu – żadna z operacji Append/Last/TrimToDays nie realokuje
+/// bufora, dopóki mieści się on w zarezerwowanej pojemności.
+/// Statystyki całej serii (Stats) i szkic jej kwantyli (Sketch) są aktualizowane przy dopisywaniu nowszego
+/// pomiaru w O(1); wstawienie w środek, nadpisanie lub przycięcie przelicza je jednym przebiegiem po serii.
+class SensorSeries {
+public:
+    size_t Size() const { return ts.size() - head; }
+    bool Empty() const { return Size() == 0; }
+    const int64_t* Times() const { return ts.data() + head; }
+    const double* Values() const { return vals.data() + head; }
+    int64_t FirstTime() const { return ts[head]; }
+    int64_t LastTime() const { return ts.back(); }
+    double Latest() const { return vals.back(); }
+    SeriesView View() const { return { Times(), Values(), Size() }; }
+    /// Statystyki całej serii (x = numer próbki od początku serii)
+    const OnlineStats& Stats() const { return stats; }
+    /// Szkic kwantyli całej serii
+    const QuantileSketch& Sketch() const { return sketch; }
+
+    void Reserve(size_t n) {
+        ts.reserve(head + n);
+        vals.reserve(head + n);
+    }
+
+    /// Dodaje pomiar; ten sam czas nadpisuje wartość, starszy pomiar trafia na właściwe miejsce
+    void Append(int64_t t, double v) {
+        if (!Empty() && t <= ts.back()) {
+            auto it = std::lower_bound(ts.begin() + head, ts.end(), t);
+            size_t i = it - ts.begin();
+            if (it != ts.end() && *it == t) {
+                vals[i] = v;
+            }
+            else {
+                ts.insert(it, t);
+                vals.insert(vals.begin() + i, v);
+            }
+            RebuildSummary();
+            return;
+        }
+        if (head > 0 && ts.size() == ts.capacity())
+            Compact();
+        ts.push_back(t);
+        vals.push_back(v);
+        stats.Push(t, v);
+        sketch.Push(v);
+    }
+
+    void Append(system_clock::time_point tp, double v) { Append(static_cast<int64_t>(system_clock::to_time_t(tp)), v); }
+
+    /// Zastępuje zawartość gotowymi kolumnami (kopiowanie blokowe, bez przetwarzania pojedynczych wartości)
+    void AssignColumns(const int64_t* t, const double* v, size_t n) {
+        head = 0;
+        ts.resize(n);
+        vals.resize(n);
+        stats = OnlineStats();
+        sketch.Clear();
+        if (n == 0) return;
+        memcpy(ts.data(), t, n * sizeof(int64_t));
+        memcpy(vals.data(), v, n * sizeof(double));
+        if (!std::is_sorted(ts.begin(), ts.end())) {
+            // Porządek jak przy kolejnych Append: sortowanie stabilne, z powtórzonych czasów zostaje ostatnia wartość
+            std::vector<size_t> order(n);
+            std::iota(order.begin(), order.end(), size_t(0));
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return t[a] < t[b]; });
+            ts.clear();
+            vals.clear();
+            for (size_t i : order) {
+                if (!ts.empty() && ts.back() == t[i]) vals.back() = v[i];
+                else { ts.push_back(t[i]); vals.push_back(v[i]); }
+            }
+        }
+        RebuildSummary();
+    }
+
+    /// Zastępuje zawartość posortowaną serią punktów
+    void Assign(const Series& points) {
+        Clear();
+        Reserve(points.size());
+        for (const auto& [tp, v] : points)
+            Append(tp, v);
+    }
+
+    /// Ostatnie n pomiarów
+    SeriesView Last(size_t n) const {
+        size_t count = std::min(n, Size());
+        size_t i = ts.size() - count;
+        return { ts.data() + i, vals.data() + i, count };
+    }
+
+    /// Zostawia tylko pomiary z ostatnich days dni (licząc od najnowszego pomiaru)
+    void TrimToDays(int days) {
+        if (Empty()) return;
+        const int64_t cutoff = ts.back() - static_cast<int64_t>(days) * 86400;
+        size_t newHead = std::lower_bound(ts.begin() + head, ts.end(), cutoff) - ts.begin();
+        if (newHead == head) return;
+        head = newHead;
+        if (head * 2 >= ts.size())
+            Compact();
+        RebuildSummary();
+    }
+
+    void Clear() {
+        ts.clear();
+        vals.clear();
+        head = 0;
+        stats = OnlineStats();
+        sketch.Clear();
+    }
+
+    /// Zamienia serię na punkty (czas, wartość) dla analizy i wykresów
+    Series ToPoints(size_t lastN = SIZE_MAX) const {
+        SeriesView v = Last(lastN);
+        Series out;
+        out.reserve(v.size);
+        for (size_t i = 0; i < v.size; ++i)
+            out.emplace_back(system_clock::from_time_t(static_cast<time_t>(v.ts[i])), v.values[i]);
+        return out;
+    }
+
+private:
+    /// Przelicza Stats i Sketch od nowa (po zmianie innej niż dopisanie na końcu)
+    void RebuildSummary();
+
+    /// Przesuwa żywe pomiary na początek bufora (w miejscu, bez zmiany pojemności)
+    void Compact() {
+        if (head == 0) return;
+        std::move(ts.begin() + head, ts.end(), ts.begin());
+        std::move(vals.begin() + head, vals.end(), vals.begin());
+        ts.resize(ts.size() - head);
+        vals.resize(vals.size() - head);
+        head = 0;
+    }
+
+    std::vector<int64_t> ts;
+    std::vector<double> vals;
+    size_t head = 0;
+    OnlineStats stats;
+    QuantileSketch sketch;
+};
+
+/// Serie wszystkich sensorów stacji: płaski, posortowany indeks id sensorów
+/// z równoległymi tablicami nazw i serii (wyszukiwanie binarne zamiast std::map)
+class SeriesStore {
+public:
+    size_t Size() const { return ids.size(); }
+    bool Empty() const { return ids.empty(); }
+    int IdAt(size_t i) const { return ids[i]; }
+    const std::string& NameAt(size_t i) const { return names[i]; }
+    const SensorSeries& SeriesAt(size_t i) const { return series[i]; }
+    SensorSeries& SeriesAt(size_t i) { return series[i]; }
+
+    /// Seria sensora; tworzy pusty wpis, jeśli sensor nie był jeszcze znany
+    SensorSeries& At(int sensorId) { return series[Slot(sensorId)]; }
+
+    const SensorSeries* Find(int sensorId) const {
+        auto it = std::lower_bound(ids.begin(), ids.end(), sensorId);
+        return it != ids.end() && *it == sensorId ? &series[it - ids.begin()] : nullptr;
+    }
+
+    const std::string* Name(int sensorId) const {
+        auto it = std::lower_bound(ids.begin(), ids.end(), sensorId);
+        return it != ids.end() && *it == sensorId ? &names[it - ids.begin()] : nullptr;
+    }
+
+    void SetName(int sensorId, std::string name) { names[Slot(sensorId)] = std::move(name); }
+
+private:
+    size_t Slot(int sensorId) {
+        auto it = std::lower_bound(ids.begin(), ids.end(), sensorId);
+        size_t i = it - ids.begin();
+        if (it == ids.end() || *it != sensorId) {
+            ids.insert(it, sensorId);
+            names.insert(names.begin() + i, std::string());
+            series.insert(series.begin() + i, SensorSeries());
+        }
+        return i;
+    }
+
+    std::vector<int> ids;
+    std::vector<std::string> names;
+    std::vector<SensorSeries> series;
+};
+
+/// Ile dni średnich z pobrań przechowuje Station::history
+constexpr int kHistoryRetentionDays = 365;
+
 /// Struktura reprezentująca stację monitoringu AQI
 struct Station {
     int id = 0;
     std::string name, city, region;
     double lat = 0, lon = 0;
-    std::vector<double> history;
-    std::map<int, std::vector<double>> sensor_history;
-    std::map<int, std::string> sensor_names;  // Przechowywanie nazw sensorów
+    SensorSeries history;   // średnie z kolejnych pobrań, ze znacznikiem czasu ostatniego pomiaru
+    SeriesStore sensors;    // serie i nazwy sensorów stacji
 
     /// Zwraca ostatnią wartość pomiaru, lub 0 jeśli brak danych
-    double latest() const { return history.empty() ? 0.0 : history.back(); }
+    double latest() const { return history.Empty() ? 0.0 : history.Latest(); }
 };
 
 /// Struktura analizy danych sensorycznych
@@ -102,13 +547,10 @@ struct WinHttpHandle {
 
 std::vector<Station> FetchAll();
 std::vector<Sensor> FetchSensors(int sid);
-json FetchData(int sensorId);
-void SaveDB(const std::string& fn, const std::vector<std::string>& dates, const Station& station);
-
-// Zmienne stanu dla wielowątkowości
-std::future<std::vector<Station>> stations_future;
-bool is_fetching_stations = false;
-std::mutex stations_mutex;
+Series FetchData(int sensorId);
+void SaveDB(const std::string& fn, const std::vector<std::string>& dates, const Station& station, bool binary);
+void WriteFileAtomic(const std::string& path, const std::string& data);
+bool WriteFileDurable(const std::string& path, const std::string& data, bool append);
 
 //******************************************************************************************
 // Exceptions
@@ -120,6 +562,92 @@ public:
     using std::runtime_error::runtime_error;
 };
 
+//******************************************************************************************
+// Anulowanie operacji
+//******************************************************************************************
+
+/// Token anulowania: kopie współdzielą stan, pusty token nigdy nie jest anulowany.
+/// Akcje zarejestrowane przez OnCancel (np. wybudzenie wątku czekającego na zapytanie HTTP) wykonują się
+/// w wątku wołającym Cancel, co przerywa oczekiwanie trwające w innym wątku
+class CancellationToken {
+public:
+    static CancellationToken Create() {
+        CancellationToken token;
+        token.state = std::make_shared<State>();
+        return token;
+    }
+
+    void Cancel() const {
+        if (!state || state->cancelled.exchange(true)) return;
+        std::map<uint64_t, std::function<void()>> actions;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            actions.swap(state->actions);
+        }
+        for (auto& a : actions)
+            a.second();
+    }
+
+    bool IsCancelled() const { return state && state->cancelled.load(); }
+
+    /// Rejestruje akcję anulowania; przy już anulowanym tokenie wykonuje ją od razu.
+    /// Zwraca identyfikator dla Unregister (0 – nic nie zarejestrowano)
+    uint64_t OnCancel(std::function<void()> fn) const {
+        if (!state) return 0;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->cancelled.load()) {
+                const uint64_t id = state->nextId++;
+                state->actions.emplace(id, std::move(fn));
+                return id;
+            }
+        }
+        fn();
+        return 0;
+    }
+
+    void Unregister(uint64_t id) const {
+        if (!state || id == 0) return;
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->actions.erase(id);
+    }
+
+    /// Token zadania wykonywanego w bieżącym wątku (ustawiany przez CancellationScope)
+    static const CancellationToken& Current() { return Slot(); }
+
+private:
+    friend class CancellationScope;
+
+    struct State {
+        std::atomic<bool> cancelled{ false };
+        std::mutex mutex;
+        std::map<uint64_t, std::function<void()>> actions;
+        uint64_t nextId = 1;
+    };
+
+    static CancellationToken& Slot() {
+        thread_local CancellationToken current;
+        return current;
+    }
+
+    std::shared_ptr<State> state;
+};
+
+/// Ustawia token bieżącego zadania w tym wątku na czas życia obiektu; z niego korzystają
+/// niższe warstwy (zapytania HTTP), bez przekazywania tokenu przez każdą funkcję
+class CancellationScope {
+public:
+    explicit CancellationScope(CancellationToken token) : previous(std::move(CancellationToken::Slot())) {
+        CancellationToken::Slot() = std::move(token);
+    }
+    ~CancellationScope() { CancellationToken::Slot() = std::move(previous); }
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+
+private:
+    CancellationToken previous;
+};
+
 //******************************************************************************************
 // HTTP Helpers
 //******************************************************************************************
@@ -144,150 +672,782 @@ bool IsInternetAvailable() {
     return InternetGetConnectedState(&flags, 0) == TRUE;
 }
 
-/// Wysyła zapytanie HTTP GET i zwraca odpowiedź jako std::string
-std::string HttpGet(const std::wstring& host, const std::wstring& path) {
-    WinHttpHandle hSession(WinHttpOpen(L"AQIApp/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0));
-    if (!hSession) throw NetworkException("WinHttpOpen failed");
+/// Pula połączeń HTTP współdzielona przez wszystkie zapytania (FetchAll, FetchSensors, FetchData, Geocode).
+/// Jedna sesja WinHTTP na cały proces utrzymuje gniazda keep-alive i pamięć sesji TLS,
+/// a uchwyty połączeń są grupowane wg hosta, ograniczane liczbowo i zamykane po okresie bezczynności.
+class HttpConnectionPool {
+public:
+    static constexpr int kMaxConnsPerHost = 6;
+    static constexpr seconds kIdleTimeout{ 60 };
 
-    WinHttpHandle hConnect(WinHttpConnect(hSession, host.c_str(), INTERNET_DEFAULT_HTTPS_PORT, 0));
-    if (!hConnect) throw NetworkException("WinHttpConnect failed");
+    /// Dzierżawa połączenia – w destruktorze wraca do puli (lub zostaje zamknięta po Discard())
+    class Lease {
+    public:
+        Lease(HttpConnectionPool* pool, std::wstring host, HINTERNET handle)
+            : pool(pool), host(std::move(host)), handle(handle) {}
+        Lease(Lease&& o) noexcept
+            : pool(o.pool), host(std::move(o.host)), handle(o.handle), reusable(o.reusable) { o.pool = nullptr; }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { if (pool) pool->Release(host, handle, reusable); }
 
-    WinHttpHandle hRequest(WinHttpOpenRequest(hConnect, L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, WINHTTP_FLAG_SECURE));
-    if (!hRequest) throw NetworkException("WinHttpOpenRequest failed");
+        operator HINTERNET() const { return handle; }
+        /// Oznacza połączenie jako uszkodzone – nie wróci do puli
+        void Discard() { reusable = false; }
 
-    if (!WinHttpSendRequest(hRequest, WINHTTP_NO_ADDITIONAL_HEADERS, 0,
-        WINHTTP_NO_REQUEST_DATA, 0, 0, 0) ||
-        !WinHttpReceiveResponse(hRequest, nullptr))
-    {
-        WinHttpCloseHandle(hRequest);
-        WinHttpCloseHandle(hConnect);
-        WinHttpCloseHandle(hSession);
-        throw NetworkException("HTTP request failed");
-    }
+    private:
+        HttpConnectionPool* pool;
+        std::wstring host;
+        HINTERNET handle;
+        bool reusable = true;
+    };
 
-    std::string res;
-    DWORD avail = 0;
-    while (WinHttpQueryDataAvailable(hRequest, &avail) && avail) {
-        std::vector<char> buf(avail + 1);
-        DWORD read = 0;
-        WinHttpReadData(hRequest, buf.data(), avail, &read);
-        buf[read] = '\0';
-        res += buf.data();
+    static HttpConnectionPool& Instance() {
+        static HttpConnectionPool pool;
+        return pool;
     }
 
-    WinHttpCloseHandle(hRequest);
-    WinHttpCloseHandle(hConnect);
-    WinHttpCloseHandle(hSession);
-    return res;
-}
+    /// Pobiera wolne połączenie do hosta, w razie potrzeby czekając aż zwolni się miejsce w limicie
+    Lease Acquire(const std::wstring& host) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!session) throw NetworkException("WinHttpOpen failed");
+        auto& slot = hosts[host];
+        cv.wait(lock, [&] { return !slot.idle.empty() || slot.in_use < kMaxConnsPerHost; });
+        EvictIdle(steady_clock::now());
 
-/// Funkcja opakowująca HttpGet aby bezpiecznie pobierać dane
-std::string SafeGet(const std::wstring& h, const std::wstring& p) {
-    try {
-        return HttpGet(h, p);
+        HINTERNET h = nullptr;
+        if (!slot.idle.empty()) {
+            h = slot.idle.back().handle;   // najświeższe połączenie ma największą szansę na żywe gniazdo
+            slot.idle.pop_back();
+        }
+        else {
+            h = WinHttpConnect(session, host.c_str(), INTERNET_DEFAULT_HTTPS_PORT, 0);
+            if (!h) throw NetworkException("WinHttpConnect failed");
+        }
+        ++slot.in_use;
+        return Lease(this, host, h);
     }
-    catch (std::exception& e) {
-        throw NetworkException(e.what());
+
+    ~HttpConnectionPool() {
+        for (auto& [host, slot] : hosts)
+            for (auto& c : slot.idle)
+                WinHttpCloseHandle(c.handle);
+        if (session) WinHttpCloseHandle(session);
     }
-}
 
-//******************************************************************************************
-// Geocode & Distance Calculations
-//******************************************************************************************
+private:
+    struct IdleConn {
+        HINTERNET handle;
+        steady_clock::time_point since;
+    };
+    struct HostSlot {
+        std::vector<IdleConn> idle;
+        int in_use = 0;
+    };
 
-/// Konwersja stopni na radiany
-double Deg2Rad(double d) {
-    return d * PI / 180.0;
-}
+    HttpConnectionPool() {
+        // Tryb asynchroniczny: anulowanie nie musi zamykać uchwytu zapytania z obcego wątku (CancellableRequest)
+        session = WinHttpOpen(L"AQIApp/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, WINHTTP_FLAG_ASYNC);
+        if (session) {
+            DWORD maxConns = kMaxConnsPerHost;
+            WinHttpSetOption(session, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &maxConns, sizeof(maxConns));
+        }
+    }
 
-/// Oblicza odległość między dwoma punktami geograficznymi przy użyciu formuły haversine
-double Haversine(double lat1, double lon1, double lat2, double lon2) {
-    double dlat = Deg2Rad(lat2 - lat1), dlon = Deg2Rad(lon2 - lon1);
-    double a = sin(dlat / 2) * sin(dlat / 2)
-        + cos(Deg2Rad(lat1)) * cos(Deg2Rad(lat2))
-        * sin(dlon / 2) * sin(dlon / 2);
-    return 6371.0 * 2 * atan2(sqrt(a), sqrt(1 - a));
-}
+    void Release(const std::wstring& host, HINTERNET h, bool reusable) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& slot = hosts[host];
+            --slot.in_use;
+            if (reusable)
+                slot.idle.push_back({ h, steady_clock::now() });
+            else
+                WinHttpCloseHandle(h);
+            EvictIdle(steady_clock::now());
+        }
+        cv.notify_one();
+    }
 
-/// Geokodowanie adresu przy użyciu Nominatim API (OpenStreetMap)
-std::pair<double, double> Geocode(const std::string& addr) {
-    std::string q = "q=" + UrlEncode(addr) + "&format=json&limit=1";
-    std::wstring path = L"/search?" + std::wstring(q.begin(), q.end());
+    /// Zamyka połączenia bezczynne dłużej niż kIdleTimeout (wywoływane pod blokadą)
+    void EvictIdle(steady_clock::time_point now) {
+        for (auto& [host, slot] : hosts) {
+            auto stale = std::remove_if(slot.idle.begin(), slot.idle.end(), [&](const IdleConn& c) {
+                if (now - c.since < kIdleTimeout) return false;
+                WinHttpCloseHandle(c.handle);
+                return true;
+                });
+            slot.idle.erase(stale, slot.idle.end());
+        }
+    }
 
-    std::string resp;
-    try {
-        resp = SafeGet(L"nominatim.openstreetmap.org", path);
-        std::ofstream("last_geocode.json") << resp; // DEBUG
+    HINTERNET session = nullptr;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<std::wstring, HostSlot> hosts;
+};
+
+/// Uchwyt zapytania HTTP (sesja w trybie asynchronicznym) powiązany z tokenem bieżącego zadania.
+/// Operacje WinHTTP są rozpoczynane przez Await, które czeka na powiadomienie o ich zakończeniu.
+/// Anulowanie tylko ustawia znacznik i budzi czekający wątek; uchwyt zamyka zawsze wątek roboczy
+/// (w Await albo w destruktorze) i czeka na WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING, więc żadne wywołanie
+/// nie trafia na zamknięty uchwyt, a bufor przerwanego odczytu pozostaje ważny do końca zamykania.
+class CancellableRequest {
+public:
+    explicit CancellableRequest(HINTERNET h) : shared(std::make_shared<Shared>()), token(CancellationToken::Current()) {
+        shared->handle = h;
+        DWORD_PTR context = Context();
+        if (!WinHttpSetOption(h, WINHTTP_OPTION_CONTEXT_VALUE, &context, sizeof(context)) ||
+            WinHttpSetStatusCallback(h, &Shared::OnStatus, WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS | WINHTTP_CALLBACK_FLAG_HANDLES, 0)
+            == WINHTTP_INVALID_STATUS_CALLBACK) {
+            WinHttpCloseHandle(h);
+            throw NetworkException("WinHttpSetStatusCallback failed");
+        }
+        registration = token.OnCancel([s = shared]() { s->Abort(); });
     }
-    catch (const NetworkException& e) {
-        throw NetworkException("Błąd geokodowania: " + std::string(e.what()));
+    ~CancellableRequest() {
+        token.Unregister(registration);
+        shared->CloseAndWait();
     }
+    CancellableRequest(const CancellableRequest&) = delete;
+    CancellableRequest& operator=(const CancellableRequest&) = delete;
 
-    try {
-        auto arr = json::parse(resp);
+    /// Uchwyt do wywołań synchronicznych (WinHttpQueryHeaders)
+    HINTERNET Handle() const { return shared->handle; }
+    /// Wartość kontekstu przekazywana do WinHttpSendRequest
+    DWORD_PTR Context() const { return reinterpret_cast<DWORD_PTR>(shared.get()); }
 
-        if (!arr.is_array() || arr.empty()) {
-            throw NetworkException("Brak wyników geokodowania");
+    /// Rozpoczyna operację start(uchwyt) i czeka na jej zakończenie albo anulowanie.
+    /// Zwraca długość danych z powiadomienia o zakończeniu (liczba bajtów dla WinHttpReadData)
+    template <typename F>
+    DWORD Await(HttpConnectionPool::Lease& hConnect, F start, const char* what) const {
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (shared->aborted)
+                Fail(hConnect, "Zapytanie anulowane");
+            shared->result = Shared::Pending;
+            shared->length = 0;
         }
-
-        const auto& first_result = arr[0];
-        if (!first_result.contains("lat") || !first_result["lat"].is_string() ||
-            !first_result.contains("lon") || !first_result["lon"].is_string()) {
-            throw NetworkException("Nieprawidłowa struktura odpowiedzi geokodowania");
+        if (!start(shared->handle))
+            Fail(hConnect, what);
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->cv.wait(lock, [&]() { return shared->result != Shared::Pending || shared->aborted; });
+        if (shared->result == Shared::Pending) {
+            lock.unlock();
+            shared->CloseAndWait();
+            Fail(hConnect, "Zapytanie anulowane");
         }
-        double lat = std::stod(first_result["lat"].get<std::string>());
-        double lon = std::stod(first_result["lon"].get<std::string>());
-        return { lat, lon };
+        if (shared->result == Shared::Failed)
+            Fail(hConnect, what);
+        return shared->length;
     }
-    catch (const json::exception& e) {
-        throw NetworkException("Błąd parsowania JSON: " + std::string(e.what()));
+
+    /// Zamienia błąd WinHTTP wynikający z anulowania na odpowiedni komunikat; połączenie nie wraca do puli
+    [[noreturn]] void Fail(HttpConnectionPool::Lease& hConnect, const char* what) const {
+        hConnect.Discard();
+        throw NetworkException(token.IsCancelled() ? "Zapytanie anulowane" : what);
     }
-}
 
-//******************************************************************************************
-// D3D11 + ImGui/ImPlot Setup
-//******************************************************************************************
+private:
+    struct Shared {
+        enum Result { Idle, Pending, Done, Failed };
 
-// Globalne uchwyty DirectX
-static ID3D11Device* g_pd3dDevice = nullptr;
-static ID3D11DeviceContext* g_pd3dDeviceContext = nullptr;
-static IDXGISwapChain* g_pSwapChain = nullptr;
-static ID3D11RenderTargetView* g_mainRTV = nullptr;
+        std::mutex mutex;
+        std::condition_variable cv;
+        HINTERNET handle = nullptr;
+        Result result = Idle;   // stan ostatniej operacji rozpoczętej przez Await
+        DWORD length = 0;
+        bool aborted = false;   // zapytanie anulowano
+        bool closing = false;   // WinHttpCloseHandle już wywołane (tylko wątek roboczy)
+        bool closed = false;    // WinHTTP nie użyje już uchwytu ani kontekstu
 
-/// Tworzy widok bufora renderowania
-void CreateRT() {
-    ID3D11Texture2D* pBack = nullptr;
-    HRESULT hr = g_pSwapChain->GetBuffer(0, IID_PPV_ARGS(&pBack));
-    if (SUCCEEDED(hr) && pBack != nullptr) {
-        hr = g_pd3dDevice->CreateRenderTargetView(pBack, nullptr, &g_mainRTV);
-        pBack->Release();
-        if (FAILED(hr)) {
-            MessageBox(nullptr, TEXT("Błąd tworzenia widoku renderowania"), TEXT("Błąd D3D11"), MB_ICONERROR);
+        /// Anulowanie (wątek wołający Cancel): tylko budzi wątek czekający w Await
+        void Abort() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                aborted = true;
+            }
+            cv.notify_all();
         }
+
+        /// Zamyka uchwyt i czeka, aż WinHTTP zgłosi koniec jego używania
+        void CloseAndWait() {
+            if (!closing) {
+                closing = true;
+                WinHttpCloseHandle(handle);
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return closed; });
+        }
+
+        /// Powiadomienia WinHTTP (wątki WinHTTP albo wątek rozpoczynający operację).
+        /// Powiadamianie pod blokadą: po zobaczeniu closed wątek roboczy może od razu zniszczyć stan
+        static void CALLBACK OnStatus(HINTERNET, DWORD_PTR context, DWORD status, LPVOID, DWORD length) {
+            Shared* s = reinterpret_cast<Shared*>(context);
+            if (!s) return;
+            std::lock_guard<std::mutex> lock(s->mutex);
+            switch (status) {
+            case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+            case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+            case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+                s->length = length;
+                s->result = Done;
+                break;
+            case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+                s->result = Failed;
+                break;
+            case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+                s->closed = true;
+                break;
+            default:
+                return;
+            }
+            s->cv.notify_all();
+        }
+    };
+
+    std::shared_ptr<Shared> shared;
+    CancellationToken token;
+    uint64_t registration = 0;
+};
+
+/// Otwiera zapytanie GET na dzierżawionym połączeniu
+static HINTERNET OpenGetRequest(HttpConnectionPool::Lease& hConnect, const std::wstring& path) {
+    HINTERNET hRequest = WinHttpOpenRequest(hConnect, L"GET", path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, WINHTTP_FLAG_SECURE);
+    if (!hRequest) {
+        hConnect.Discard();
+        throw NetworkException("WinHttpOpenRequest failed");
     }
-    else {
-        MessageBox(nullptr, TEXT("Błąd pobierania bufora swapchain"), TEXT("Błąd D3D11"), MB_ICONERROR);
-    }
+    return hRequest;
 }
 
-/// Czyści widok bufora renderowania
-void CleanupRT() {
-    if (g_mainRTV) { g_mainRTV->Release(); g_mainRTV = nullptr; }
+/// Wysyła zapytanie i czeka na nagłówki odpowiedzi
+static void SendGetRequest(HttpConnectionPool::Lease& hConnect, const CancellableRequest& hRequest, const std::wstring& headers = {}) {
+    hRequest.Await(hConnect, [&](HINTERNET h) {
+        return WinHttpSendRequest(h,
+            headers.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : headers.c_str(), static_cast<DWORD>(headers.size()),
+            WINHTTP_NO_REQUEST_DATA, 0, 0, hRequest.Context());
+        }, "HTTP request failed");
+    hRequest.Await(hConnect, [](HINTERNET h) { return WinHttpReceiveResponse(h, nullptr); }, "HTTP request failed");
 }
 
-/// Inicjalizuje urządzenie DirectX 11 wraz ze swapchain
-bool CreateDevice(HWND hWnd) {
-    DXGI_SWAP_CHAIN_DESC sd{};
-    sd.BufferCount = 2;
-    sd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-    sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-    sd.OutputWindow = hWnd;
-    sd.SampleDesc.Count = 1;
-    sd.Windowed = TRUE;
-    D3D_FEATURE_LEVEL fl;
-    const D3D_FEATURE_LEVEL lvls[] = { D3D_FEATURE_LEVEL_11_0, D3D_FEATURE_LEVEL_10_0 };
-    if (D3D11CreateDeviceAndSwapChain(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0,
-        lvls, 2, D3D11_SDK_VERSION, &sd,
+/// Zwraca wartość nagłówka Content-Length, lub 0 gdy serwer jej nie podał (np. chunked)
+static size_t QueryContentLength(HINTERNET hRequest) {
+    DWORD len = 0, size = sizeof(len);
+    if (!WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_CONTENT_LENGTH | WINHTTP_QUERY_FLAG_NUMBER,
+        WINHTTP_HEADER_NAME_BY_INDEX, &len, &size, WINHTTP_NO_HEADER_INDEX))
+        return 0;
+    return len;
+}
+
+/// Zwraca tekstową wartość nagłówka odpowiedzi (ASCII), lub pusty napis gdy go brak
+static std::string QueryHeaderString(HINTERNET hRequest, DWORD query) {
+    DWORD size = 0;
+    WinHttpQueryHeaders(hRequest, query, WINHTTP_HEADER_NAME_BY_INDEX, nullptr, &size, WINHTTP_NO_HEADER_INDEX);
+    if (GetLastError() != ERROR_INSUFFICIENT_BUFFER || size == 0)
+        return {};
+    std::wstring value(size / sizeof(wchar_t), L'\0');
+    if (!WinHttpQueryHeaders(hRequest, query, WINHTTP_HEADER_NAME_BY_INDEX, &value[0], &size, WINHTTP_NO_HEADER_INDEX))
+        return {};
+    value.resize(size / sizeof(wchar_t));
+    return std::string(value.begin(), value.end());
+}
+
+/// Zapytanie HTTP GET, którego treść odbiorca czyta na żądanie, fragment po fragmencie.
+/// Kod statusu i nagłówki walidacyjne są dostępne zaraz po konstrukcji; niedoczytana treść
+/// zostaje na połączeniu, więc takie połączenie nie wraca do puli.
+class HttpBodyReader {
+public:
+    HttpBodyReader(const std::wstring& host, const std::wstring& path, const std::wstring& headers = {})
+        : hConnect(HttpConnectionPool::Instance().Acquire(host)), hRequest(OpenGetRequest(hConnect, path)) {
+        SendGetRequest(hConnect, hRequest, headers);
+        const HINTERNET h = hRequest.Handle();
+        DWORD statusSize = sizeof(status);
+        WinHttpQueryHeaders(h, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+            WINHTTP_HEADER_NAME_BY_INDEX, &status, &statusSize, WINHTTP_NO_HEADER_INDEX);
+        etag = QueryHeaderString(h, WINHTTP_QUERY_ETAG);
+        lastModified = QueryHeaderString(h, WINHTTP_QUERY_LAST_MODIFIED);
+        contentLength = QueryContentLength(h);
+    }
+    ~HttpBodyReader() {
+        if (!finished) hConnect.Discard();
+    }
+    HttpBodyReader(const HttpBodyReader&) = delete;
+    HttpBodyReader& operator=(const HttpBodyReader&) = delete;
+
+    /// Czyta do size bajtów treści do dst; 0 oznacza koniec treści
+    size_t Read(char* dst, size_t size) {
+        if (finished) return 0;
+        // W trybie asynchronicznym liczbę bajtów podaje powiadomienie READ_COMPLETE, nie argument
+        const DWORD read = hRequest.Await(hConnect, [&](HINTERNET h) {
+            return WinHttpReadData(h, dst, static_cast<DWORD>(size), nullptr);
+            }, "WinHttpReadData failed");
+        if (read == 0) finished = true;
+        return read;
+    }
+
+    /// Doczytuje pozostałą treść na koniec out (bufor rezerwowany wg Content-Length)
+    void ReadAll(std::string& out) {
+        out.reserve(out.size() + contentLength);
+        while (!finished) {
+            size_t used = out.size();
+            out.resize(used + kChunk);
+            out.resize(used + Read(&out[used], kChunk));
+        }
+    }
+
+    static constexpr size_t kChunk = 64 * 1024;
+
+    DWORD status = 0;
+    std::string etag, lastModified;
+    size_t contentLength = 0;   // 0 gdy serwer nie podał (np. chunked)
+
+private:
+    HttpConnectionPool::Lease hConnect;
+    CancellableRequest hRequest;
+    bool finished = false;
+};
+
+/// Treść odpowiedzi jako std::streambuf dla parserów czytających std::istream (json::sax_parse).
+/// Kolejne fragmenty są czytane z sieci dopiero, gdy parser dojdzie do końca poprzedniego, i trafiają
+/// wprost na koniec bufora body – parser czyta je w miejscu, a po odczycie body zawiera całą treść
+/// (np. do zapisania w pamięci podręcznej).
+class HttpBodyBuf : public std::streambuf {
+public:
+    explicit HttpBodyBuf(HttpBodyReader& reader) : reader(reader) {
+        body.reserve(reader.contentLength);
+    }
+
+    /// Doczytuje treść, której parser nie potrzebował, i oddaje całość
+    std::string Take() {
+        reader.ReadAll(body);
+        setg(nullptr, nullptr, nullptr);
+        return std::move(body);
+    }
+
+protected:
+    int_type underflow() override {
+        // poprzedni fragment jest już w całości przeczytany, więc realokacja body go nie unieważnia
+        size_t used = body.size();
+        body.resize(used + HttpBodyReader::kChunk);
+        size_t n = reader.Read(&body[used], HttpBodyReader::kChunk);
+        body.resize(used + n);
+        if (n == 0) return traits_type::eof();
+        setg(&body[used], &body[used], &body[used] + n);
+        return traits_type::to_int_type(body[used]);
+    }
+
+private:
+    HttpBodyReader& reader;
+    std::string body;
+};
+
+/// Wysyła zapytanie HTTP GET i zwraca odpowiedź jako std::string
+std::string HttpGet(const std::wstring& host, const std::wstring& path) {
+    HttpBodyReader reader(host, path);
+    std::string body;
+    reader.ReadAll(body);
+    return body;
+}
+
+/// Pamięć podręczna odpowiedzi HTTP na dysku (katalog cache/), adresowana skrótem URL.
+/// Wpisy świeże wg TTL danego endpointu są zwracane z pamięci bez dostępu do sieci;
+/// przeterminowane są walidowane zapytaniem warunkowym (If-None-Match / If-Modified-Since),
+/// a przy braku sieci zwracana jest ostatnia znana odpowiedź.
+/// GetParsed parsuje nową treść handlerem SAX już w trakcie pobierania.
+class HttpCache {
+public:
+    static HttpCache& Instance() {
+        static HttpCache cache;
+        return cache;
+    }
+
+    std::string Get(const std::wstring& host, const std::wstring& path) {
+        return Fetch(host, path, [](HttpBodyReader& reader) {
+            std::string body;
+            reader.ReadAll(body);
+            return body;
+            });
+    }
+
+    /// Jak Get, ale zwraca treść sparsowaną handlerem Sax (pochodnym JsonPathSax). Nowa treść (200)
+    /// jest parsowana fragmentami, w miarę nadchodzenia z sieci; treść z pamięci podręcznej – w całości.
+    /// Gdy body != nullptr, dostaje surową treść.
+    template <typename Sax>
+    Sax GetParsed(const std::wstring& host, const std::wstring& path, std::string* body = nullptr) {
+        Sax sax;
+        bool streamed = false;
+        std::string text = Fetch(host, path, [&](HttpBodyReader& reader) {
+            HttpBodyBuf buf(reader);
+            std::istream in(&buf);
+            sax.Parse(in);
+            streamed = true;
+            return buf.Take();
+            });
+        if (!streamed) {
+            sax = Sax();   // przerwane parsowanie strumieniowe mogło zostawić częściowy stan
+            sax.Parse(text);
+        }
+        if (body) *body = std::move(text);
+        return sax;
+    }
+
+private:
+    struct Entry {
+        std::string body, etag, lastModified;
+        time_t storedAt = 0;
+    };
+
+    /// Wspólna ścieżka Get/GetParsed: zwraca treść świeżego lub potwierdzonego (304) wpisu, a nową
+    /// treść (200) czyta consume(reader) i zwraca ją do zapisania. Błąd sieci lub treści w trakcie
+    /// consume daje ostatnią znaną odpowiedź, jeśli taka jest.
+    std::string Fetch(const std::wstring& host, const std::wstring& path,
+        const std::function<std::string(HttpBodyReader&)>& consume) {
+        const std::string key = KeyFor(host, path);
+        const time_t now = time(nullptr);
+        const seconds ttl = TtlFor(host, path);
+
+        Entry cached;
+        bool have = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = memory.find(key);
+            if (it == memory.end() && LoadFromDisk(key, cached))
+                it = memory.emplace(key, cached).first;
+            if (it != memory.end()) {
+                if (seconds(now - it->second.storedAt) < ttl)
+                    return it->second.body;
+                cached = it->second;
+                have = true;
+            }
+        }
+
+        std::wstring headers;
+        if (have && !cached.etag.empty())
+            headers += L"If-None-Match: " + std::wstring(cached.etag.begin(), cached.etag.end()) + L"\r\n";
+        if (have && !cached.lastModified.empty())
+            headers += L"If-Modified-Since: " + std::wstring(cached.lastModified.begin(), cached.lastModified.end()) + L"\r\n";
+
+        Entry fresh;
+        try {
+            HttpBodyReader resp(host, path, headers);
+            if (resp.status == 304 && have) {
+                fresh = std::move(cached);
+                if (!resp.etag.empty()) fresh.etag = resp.etag;
+                if (!resp.lastModified.empty()) fresh.lastModified = resp.lastModified;
+                resp.ReadAll(fresh.body);   // 304 nie ma treści; domyka odpowiedź przed zwrotem połączenia
+            }
+            else if (resp.status == 200) {
+                fresh.body = consume(resp);
+                fresh.etag = std::move(resp.etag);
+                fresh.lastModified = std::move(resp.lastModified);
+            }
+            else {
+                if (have) return cached.body;
+                throw NetworkException("HTTP " + std::to_string(resp.status));
+            }
+        }
+        catch (const NetworkException&) {
+            // brak sieci lub uszkodzona treść – ostatnia znana odpowiedź (anulowane żądanie nie potrzebuje wyniku)
+            if (have && !CancellationToken::Current().IsCancelled()) return cached.body;
+            throw;
+        }
+        fresh.storedAt = now;
+        StoreToDisk(key, host, path, fresh);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& slot = memory[key];
+        slot = std::move(fresh);
+        return slot.body;
+    }
+
+    /// Czas świeżości odpowiedzi zależny od endpointu
+    static seconds TtlFor(const std::wstring& host, const std::wstring& path) {
+        if (host == L"nominatim.openstreetmap.org") return hours(24 * 30);
+        if (path.find(L"/station/findAll") != std::wstring::npos) return hours(24);
+        if (path.find(L"/station/sensors/") != std::wstring::npos) return hours(24);
+        if (path.find(L"/data/getData/") != std::wstring::npos) return minutes(10);  // dane godzinowe
+        return seconds(0);
+    }
+
+    /// Nazwa pliku wpisu: skrót FNV-1a 64 z adresu URL
+    static std::string KeyFor(const std::wstring& host, const std::wstring& path) {
+        uint64_t h = 14695981039346656037ull;
+        auto mix = [&](const std::wstring& s) {
+            for (wchar_t c : s) { h ^= static_cast<uint64_t>(c); h *= 1099511628211ull; }
+            };
+        mix(host);
+        mix(path);
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+        return buf;
+    }
+
+    /// Wpis to jeden plik cache/<klucz>.entry: wiersz metadanych JSON (z długością treści), a po nim treść
+    bool LoadFromDisk(const std::string& key, Entry& e) {
+        std::ifstream in("cache/" + key + ".entry", std::ios::binary);
+        std::string header;
+        if (!in || !std::getline(in, header)) return false;
+        auto j = json::parse(header, nullptr, false);
+        if (j.is_discarded() || !j.is_object()) return false;
+        e.etag = j.value("etag", "");
+        e.lastModified = j.value("lastModified", "");
+        e.storedAt = j.value("storedAt", static_cast<time_t>(0));
+        e.body.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return e.body.size() == j.value("bodySize", static_cast<size_t>(0));   // ucięty wpis nie jest poprawny
+    }
+
+    /// Metadane i treść zapisywane są razem jednym atomowym podstawieniem pliku, więc równoległy
+    /// zapis tego samego klucza nie może połączyć treści jednej odpowiedzi z metadanymi drugiej
+    void StoreToDisk(const std::string& key, const std::wstring& host, const std::wstring& path, const Entry& e) {
+        CreateDirectoryA("cache", nullptr);
+        json j;
+        j["url"] = std::string(host.begin(), host.end()) + std::string(path.begin(), path.end());
+        j["etag"] = e.etag;
+        j["lastModified"] = e.lastModified;
+        j["storedAt"] = e.storedAt;
+        j["bodySize"] = e.body.size();
+        std::string record = j.dump();
+        record += '\n';
+        record += e.body;
+        try {
+            WriteFileAtomic("cache/" + key + ".entry", record);
+        }
+        catch (const std::exception&) {
+            // brak zapisu na dysk – wpis zostaje tylko w pamięci
+        }
+    }
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> memory;
+};
+
+/// Funkcja opakowująca HttpGet aby bezpiecznie pobierać dane (przez pamięć podręczną HttpCache)
+std::string SafeGet(const std::wstring& h, const std::wstring& p) {
+    try {
+        return HttpCache::Instance().Get(h, p);
+    }
+    catch (std::exception& e) {
+        throw NetworkException(e.what());
+    }
+}
+
+//******************************************************************************************
+// Geocode & Distance Calculations
+//******************************************************************************************
+
+/// Konwersja stopni na radiany
+double Deg2Rad(double d) {
+    return d * PI / 180.0;
+}
+
+/// Promień Ziemi używany we wszystkich obliczeniach odległości
+constexpr double EARTH_RADIUS_KM = 6371.0;
+
+/// Oblicza odległość między dwoma punktami geograficznymi przy użyciu formuły haversine
+double Haversine(double lat1, double lon1, double lat2, double lon2) {
+    double dlat = Deg2Rad(lat2 - lat1), dlon = Deg2Rad(lon2 - lon1);
+    double a = sin(dlat / 2) * sin(dlat / 2)
+        + cos(Deg2Rad(lat1)) * cos(Deg2Rad(lat2))
+        * sin(dlon / 2) * sin(dlon / 2);
+    return EARTH_RADIUS_KM * 2 * atan2(sqrt(a), sqrt(1 - a));
+}
+
+/// Wartości trygonometryczne punktu potrzebne do haversine: sin/cos połowy szerokości i długości
+/// geograficznej oraz cos szerokości – liczone raz, potem odległość nie wymaga funkcji trygonometrycznych
+struct GeoTrig {
+    double sinHalfLat, cosHalfLat, sinHalfLon, cosHalfLon, cosLat;
+
+    static GeoTrig Of(double latDeg, double lonDeg) {
+        const double hLat = Deg2Rad(latDeg) / 2, hLon = Deg2Rad(lonDeg) / 2;
+        return { sin(hLat), cos(hLat), sin(hLon), cos(hLon), cos(Deg2Rad(latDeg)) };
+    }
+};
+
+/// Współrzędne punktów w układzie struktury tablic (SoA), z GeoTrig policzonym raz przy dodawaniu punktu
+struct GeoPointsSoA {
+    std::vector<double> sinHalfLat, cosHalfLat, sinHalfLon, cosHalfLon, cosLat;
+
+    void Add(const GeoTrig& t) {
+        sinHalfLat.push_back(t.sinHalfLat);
+        cosHalfLat.push_back(t.cosHalfLat);
+        sinHalfLon.push_back(t.sinHalfLon);
+        cosHalfLon.push_back(t.cosHalfLon);
+        cosLat.push_back(t.cosLat);
+    }
+    void Add(double latDeg, double lonDeg) { Add(GeoTrig::Of(latDeg, lonDeg)); }
+    void Reserve(size_t n) {
+        for (auto* col : { &sinHalfLat, &cosHalfLat, &sinHalfLon, &cosHalfLon, &cosLat })
+            col->reserve(n);
+    }
+    size_t Size() const { return sinHalfLat.size(); }
+};
+
+/// Składnik haversine a = sin²(dφ/2) + cos φ1 cos φ2 sin²(dλ/2), gdzie sin(dφ/2) wyznaczany jest
+/// z połówek kątów: sin(φ2/2) cos(φ1/2) - cos(φ2/2) sin(φ1/2). Postać sin² zachowuje dokładność
+/// także dla odcinków rzędu metrów, w odróżnieniu od (1 - cos x) / 2
+inline double HavTerm(const GeoTrig& p, const GeoTrig& q) {
+    const double sLat = q.sinHalfLat * p.cosHalfLat - q.cosHalfLat * p.sinHalfLat;
+    const double sLon = q.sinHalfLon * p.cosHalfLon - q.cosHalfLon * p.sinHalfLon;
+    return sLat * sLat + p.cosLat * q.cosLat * sLon * sLon;
+}
+
+/// Zamienia składnik haversine na odległość w km
+inline double HavTermToKm(double a) {
+    return EARTH_RADIUS_KM * 2 * asin(sqrt(std::min(1.0, std::max(0.0, a))));
+}
+
+#if defined(AQI_X86)
+/// Pętla główna HaversineBatch dla AVX2: sqrt(a) po 4 punkty. Zwraca liczbę policzonych punktów.
+AQI_TARGET_AVX2 static size_t HavSqrtAvx2(const GeoTrig& c, const GeoPointsSoA& pts, double* outKm) {
+    const size_t n = pts.Size();
+    const double* shl = pts.sinHalfLat.data();
+    const double* chl = pts.cosHalfLat.data();
+    const double* sho = pts.sinHalfLon.data();
+    const double* cho = pts.cosHalfLon.data();
+    const double* cl = pts.cosLat.data();
+    const __m256d vsHLat = _mm256_set1_pd(c.sinHalfLat), vcHLat = _mm256_set1_pd(c.cosHalfLat);
+    const __m256d vsHLon = _mm256_set1_pd(c.sinHalfLon), vcHLon = _mm256_set1_pd(c.cosHalfLon);
+    const __m256d vcLat = _mm256_set1_pd(c.cosLat);
+    const __m256d one = _mm256_set1_pd(1.0), zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d sLat = _mm256_sub_pd(_mm256_mul_pd(_mm256_loadu_pd(shl + i), vcHLat), _mm256_mul_pd(_mm256_loadu_pd(chl + i), vsHLat));
+        __m256d sLon = _mm256_sub_pd(_mm256_mul_pd(_mm256_loadu_pd(sho + i), vcHLon), _mm256_mul_pd(_mm256_loadu_pd(cho + i), vsHLon));
+        __m256d a = _mm256_add_pd(_mm256_mul_pd(sLat, sLat),
+            _mm256_mul_pd(_mm256_mul_pd(vcLat, _mm256_loadu_pd(cl + i)), _mm256_mul_pd(sLon, sLon)));
+        a = _mm256_min_pd(_mm256_max_pd(a, zero), one);
+        _mm256_storeu_pd(outKm + i, _mm256_sqrt_pd(a));
+    }
+    return i;
+}
+#endif
+
+#if defined(AQI_SSE2)
+/// Pętla główna HaversineBatch dla SSE2: sqrt(a) po 2 punkty. Zwraca liczbę policzonych punktów.
+static size_t HavSqrtSse2(const GeoTrig& c, const GeoPointsSoA& pts, double* outKm) {
+    const size_t n = pts.Size();
+    const double* shl = pts.sinHalfLat.data();
+    const double* chl = pts.cosHalfLat.data();
+    const double* sho = pts.sinHalfLon.data();
+    const double* cho = pts.cosHalfLon.data();
+    const double* cl = pts.cosLat.data();
+    const __m128d vsHLat = _mm_set1_pd(c.sinHalfLat), vcHLat = _mm_set1_pd(c.cosHalfLat);
+    const __m128d vsHLon = _mm_set1_pd(c.sinHalfLon), vcHLon = _mm_set1_pd(c.cosHalfLon);
+    const __m128d vcLat = _mm_set1_pd(c.cosLat);
+    const __m128d one = _mm_set1_pd(1.0), zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d sLat = _mm_sub_pd(_mm_mul_pd(_mm_loadu_pd(shl + i), vcHLat), _mm_mul_pd(_mm_loadu_pd(chl + i), vsHLat));
+        __m128d sLon = _mm_sub_pd(_mm_mul_pd(_mm_loadu_pd(sho + i), vcHLon), _mm_mul_pd(_mm_loadu_pd(cho + i), vsHLon));
+        __m128d a = _mm_add_pd(_mm_mul_pd(sLat, sLat),
+            _mm_mul_pd(_mm_mul_pd(vcLat, _mm_loadu_pd(cl + i)), _mm_mul_pd(sLon, sLon)));
+        a = _mm_min_pd(_mm_max_pd(a, zero), one);
+        _mm_storeu_pd(outKm + i, _mm_sqrt_pd(a));
+    }
+    return i;
+}
+#endif
+
+/// Oblicza odległości (km) od punktu (latDeg, lonDeg) do wszystkich punktów pts, zapisując je w outKm.
+/// Pętla główna liczy sqrt(a) po 4 (AVX2) lub 2 (SSE2) punkty naraz, wg ActiveSimd(); końcówka i asin są skalarne.
+void HaversineBatch(double latDeg, double lonDeg, const GeoPointsSoA& pts, double* outKm) {
+    const size_t n = pts.Size();
+    const GeoTrig c = GeoTrig::Of(latDeg, lonDeg);
+    size_t i = 0;
+    const SimdLevel simd = ActiveSimd();
+#if defined(AQI_X86)
+    if (simd == SimdLevel::Avx2) i = HavSqrtAvx2(c, pts, outKm);
+#endif
+#if defined(AQI_SSE2)
+    if (simd == SimdLevel::Sse2) i = HavSqrtSse2(c, pts, outKm);
+#endif
+    for (; i < n; ++i) {
+        const GeoTrig p{ pts.sinHalfLat[i], pts.cosHalfLat[i], pts.sinHalfLon[i], pts.cosHalfLon[i], pts.cosLat[i] };
+        outKm[i] = sqrt(std::min(1.0, std::max(0.0, HavTerm(c, p))));
+    }
+    for (size_t k = 0; k < n; ++k)
+        outKm[k] = EARTH_RADIUS_KM * 2 * asin(outKm[k]);
+}
+
+/// Geokodowanie adresu przy użyciu Nominatim API (OpenStreetMap)
+std::pair<double, double> Geocode(const std::string& addr) {
+    std::string q = "q=" + UrlEncode(addr) + "&format=json&limit=1";
+    std::wstring path = L"/search?" + std::wstring(q.begin(), q.end());
+
+    std::string resp;
+    try {
+        resp = SafeGet(L"nominatim.openstreetmap.org", path);
+        std::ofstream("last_geocode.json") << resp; // DEBUG
+    }
+    catch (const NetworkException& e) {
+        throw NetworkException("Błąd geokodowania: " + std::string(e.what()));
+    }
+
+    try {
+        auto arr = json::parse(resp);
+
+        if (!arr.is_array() || arr.empty()) {
+            throw NetworkException("Brak wyników geokodowania");
+        }
+
+        const auto& first_result = arr[0];
+        if (!first_result.contains("lat") || !first_result["lat"].is_string() ||
+            !first_result.contains("lon") || !first_result["lon"].is_string()) {
+            throw NetworkException("Nieprawidłowa struktura odpowiedzi geokodowania");
+        }
+        double lat = std::stod(first_result["lat"].get<std::string>());
+        double lon = std::stod(first_result["lon"].get<std::string>());
+        return { lat, lon };
+    }
+    catch (const json::exception& e) {
+        throw NetworkException("Błąd parsowania JSON: " + std::string(e.what()));
+    }
+}
+
+//******************************************************************************************
+// D3D11 + ImGui/ImPlot Setup
+//******************************************************************************************
+
+// Globalne uchwyty DirectX
+static ID3D11Device* g_pd3dDevice = nullptr;
+static ID3D11DeviceContext* g_pd3dDeviceContext = nullptr;
+static IDXGISwapChain* g_pSwapChain = nullptr;
+static ID3D11RenderTargetView* g_mainRTV = nullptr;
+
+/// Tworzy widok bufora renderowania
+void CreateRT() {
+    ID3D11Texture2D* pBack = nullptr;
+    HRESULT hr = g_pSwapChain->GetBuffer(0, IID_PPV_ARGS(&pBack));
+    if (SUCCEEDED(hr) && pBack != nullptr) {
+        hr = g_pd3dDevice->CreateRenderTargetView(pBack, nullptr, &g_mainRTV);
+        pBack->Release();
+        if (FAILED(hr)) {
+            MessageBox(nullptr, TEXT("Błąd tworzenia widoku renderowania"), TEXT("Błąd D3D11"), MB_ICONERROR);
+        }
+    }
+    else {
+        MessageBox(nullptr, TEXT("Błąd pobierania bufora swapchain"), TEXT("Błąd D3D11"), MB_ICONERROR);
+    }
+}
+
+/// Czyści widok bufora renderowania
+void CleanupRT() {
+    if (g_mainRTV) { g_mainRTV->Release(); g_mainRTV = nullptr; }
+}
+
+/// Inicjalizuje urządzenie DirectX 11 wraz ze swapchain
+bool CreateDevice(HWND hWnd) {
+    DXGI_SWAP_CHAIN_DESC sd{};
+    sd.BufferCount = 2;
+    sd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    sd.OutputWindow = hWnd;
+    sd.SampleDesc.Count = 1;
+    sd.Windowed = TRUE;
+    D3D_FEATURE_LEVEL fl;
+    const D3D_FEATURE_LEVEL lvls[] = { D3D_FEATURE_LEVEL_11_0, D3D_FEATURE_LEVEL_10_0 };
+    if (D3D11CreateDeviceAndSwapChain(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0,
+        lvls, 2, D3D11_SDK_VERSION, &sd,
         &g_pSwapChain, &g_pd3dDevice, &fl, &g_pd3dDeviceContext) != S_OK)
         return false;
     CreateRT();
@@ -312,335 +1472,2770 @@ static LRESULT CALLBACK WndProc(HWND h, UINT m, WPARAM w, LPARAM l) {
         g_pSwapChain->ResizeBuffers(0, LOWORD(l), HIWORD(l), DXGI_FORMAT_UNKNOWN, 0);
         CreateRT();
     }
-    if (m == WM_CLOSE) {
-        PostQuitMessage(0);
-        return 0;
+    if (m == WM_CLOSE) {
+        PostQuitMessage(0);
+        return 0;
+    }
+    return DefWindowProc(h, m, w, l);
+}
+
+//******************************************************************************************
+// REST Fetch Routines
+//******************************************************************************************
+
+/// Liczba dni od 1970-01-01 do podanej daty kalendarza gregoriańskiego (algorytm days_from_civil)
+constexpr int64_t DaysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+/// Liczba dni w miesiącu m roku y (kalendarz gregoriański)
+constexpr unsigned DaysInMonth(int64_t y, unsigned m) {
+    if (m == 2) return (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 29 : 28;
+    return (m == 4 || m == 6 || m == 9 || m == 11) ? 30 : 31;
+}
+
+/// Dzień (liczony od epoki) ostatniej niedzieli danego miesiąca
+constexpr int64_t LastSundayDays(int64_t y, unsigned m, unsigned lastDay) {
+    const int64_t days = DaysFromCivil(y, m, lastDay);
+    const int64_t weekday = ((days % 7) + 11) % 7;   // 1970-01-01 był czwartkiem; 0 = niedziela
+    return days - weekday;
+}
+
+/// Tabela przejść czasu letniego dla Europe/Warsaw, w sekundach czasu lokalnego (ścienny zegar).
+/// Reguła UE: czas letni od ostatniej niedzieli marca 02:00 CET do ostatniej niedzieli października 03:00 CEST.
+/// Obowiązuje w Polsce od 1996 r.; wcześniejsze lata (inne reguły, dane GIOS ich nie obejmują) liczone są jako CET.
+struct WarsawDstTable {
+    static constexpr int kFirstYear = 1996, kLastYear = 2099;
+    int64_t start[kLastYear - kFirstYear + 1] = {};
+    int64_t end[kLastYear - kFirstYear + 1] = {};
+
+    constexpr WarsawDstTable() {
+        for (int y = kFirstYear; y <= kLastYear; ++y) {
+            start[y - kFirstYear] = LastSundayDays(y, 3, 31) * 86400 + 2 * 3600;
+            end[y - kFirstYear] = LastSundayDays(y, 10, 31) * 86400 + 3 * 3600;
+        }
+    }
+
+    /// Przesunięcie względem UTC (w sekundach) dla czasu lokalnego; godzina z przestawienia jesiennego liczona jako CEST
+    constexpr int64_t OffsetForLocal(int y, int64_t local) const {
+        if (y < kFirstYear || y > kLastYear) return 3600;
+        const int i = y - kFirstYear;
+        return local >= start[i] && local < end[i] ? 7200 : 3600;
+    }
+};
+
+static constexpr WarsawDstTable kWarsawDst{};
+
+/// Parsuje datę GIOS w formacie "YYYY-MM-DD HH:MM:SS" (czas lokalny Europe/Warsaw) do chwili UTC.
+/// Przyjmuje też skrócony format "YYYY-MM-DD HH", w którym aplikacja zapisuje daty w plikach savefiles/.
+/// Stały format jest czytany bezpośrednio, bez alokacji i bez bazy stref czasowych systemu;
+/// napis dłuższy lub krótszy niż któryś z formatów jest odrzucany.
+bool ParseGiosDate(const std::string& date_str, system_clock::time_point& out) {
+    const bool hourOnly = date_str.size() == 13;
+    if (date_str.size() != 19 && !hourOnly) {
+        return false;
+    }
+    const char* p = date_str.data();
+    if (p[4] != '-' || p[7] != '-' || (p[10] != ' ' && p[10] != 'T') || (!hourOnly && (p[13] != ':' || p[16] != ':'))) {
+        return false;
+    }
+    auto num = [p](int pos, int len, int& v) {
+        v = 0;
+        for (int i = pos; i < pos + len; ++i) {
+            unsigned d = static_cast<unsigned>(p[i] - '0');
+            if (d > 9) return false;
+            v = v * 10 + static_cast<int>(d);
+        }
+        return true;
+        };
+    int y, mo, d, h, mi = 0, sec = 0;
+    if (!num(0, 4, y) || !num(5, 2, mo) || !num(8, 2, d) || !num(11, 2, h) ||
+        (!hourOnly && (!num(14, 2, mi) || !num(17, 2, sec)))) {
+        return false;
+    }
+    if (mo < 1 || mo > 12 || d < 1 || static_cast<unsigned>(d) > DaysInMonth(y, mo) || h > 23 || mi > 59 || sec > 60) {
+        return false;
+    }
+    const int64_t local = DaysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec;
+    out = system_clock::from_time_t(static_cast<time_t>(local - kWarsawDst.OffsetForLocal(y, local)));
+    return true;
+}
+
+/// Wartość skalarna zdarzenia SAX
+struct SaxScalar {
+    enum Kind { Null, Bool, Number, String } kind;
+    double number = 0;
+    const std::string* text = nullptr;
+};
+
+/// Baza handlerów SAX (nlohmann::json_sax) wypełniających struktury bezpośrednio, bez budowy drzewa DOM.
+/// Śledzi ścieżkę kluczy: path[i] to bieżący klucz w kontenerze na głębokości i (pusty dla tablic).
+/// Enter/Leave wywoływane są w kontekście rodzica otwieranego kontenera, Value w kontekście kontenera wartości.
+class JsonPathSax : public nlohmann::json_sax<json> {
+public:
+    std::string error;
+
+    bool null() override { return Value({ SaxScalar::Null }); }
+    bool boolean(bool val) override { return Value({ SaxScalar::Bool, val ? 1.0 : 0.0 }); }
+    bool number_integer(number_integer_t val) override { return Value({ SaxScalar::Number, static_cast<double>(val) }); }
+    bool number_unsigned(number_unsigned_t val) override { return Value({ SaxScalar::Number, static_cast<double>(val) }); }
+    bool number_float(number_float_t val, const string_t&) override { return Value({ SaxScalar::Number, val }); }
+    bool string(string_t& val) override {
+        SaxScalar v{ SaxScalar::String };
+        v.text = &val;
+        return Value(v);
+    }
+    bool binary(binary_t&) override { return Value({ SaxScalar::Null }); }
+
+    bool start_object(std::size_t) override { return Open(true); }
+    bool end_object() override { return Close(true); }
+    bool start_array(std::size_t) override { return Open(false); }
+    bool end_array() override { return Close(false); }
+    bool key(string_t& val) override {
+        path.back() = val;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        return Fail("Błąd parsowania JSON: " + std::string(ex.what()));
+    }
+
+    /// Parsuje tekst tym handlerem; przy błędzie rzuca NetworkException z komunikatem handlera
+    void Parse(const std::string& text) {
+        if (!json::sax_parse(text, this))
+            throw NetworkException(error.empty() ? "Nieprawidłowa odpowiedź JSON" : error);
+    }
+
+    /// Parsuje strumień (np. treść odpowiedzi HTTP w trakcie pobierania) tym handlerem
+    void Parse(std::istream& in) {
+        if (!json::sax_parse(in, this))
+            throw NetworkException(error.empty() ? "Nieprawidłowa odpowiedź JSON" : error);
+    }
+
+protected:
+    virtual bool Enter(bool isObject) { return true; }
+    virtual bool Leave(bool isObject) { return true; }
+    virtual bool Value(const SaxScalar& v) = 0;
+
+    size_t Depth() const { return path.size(); }
+    const std::string& Key() const { return path.back(); }
+    bool Fail(std::string message) {
+        if (error.empty()) error = std::move(message);
+        return false;
+    }
+
+    std::vector<std::string> path;
+
+private:
+    bool Open(bool isObject) {
+        if (!Enter(isObject)) return false;
+        path.emplace_back();
+        return true;
+    }
+    bool Close(bool isObject) {
+        path.pop_back();
+        return Leave(isObject);
+    }
+};
+
+/// Handler SAX odpowiedzi station/findAll – wypełnia Station w jednym przebiegu.
+/// Stacja bez id/nazwy lub z niepełnym obiektem city/commune jest pomijana.
+class StationListSax : public JsonPathSax {
+public:
+    std::vector<Station> out;
+    int skipped = 0;
+
+protected:
+    bool Enter(bool isObject) override {
+        if (Depth() == 0 && isObject) return Fail("Oczekiwano tablicy stacji");
+        if (Depth() == 1 && isObject) {
+            cur = Station();
+            hasId = hasName = bad = cityNeedsName = communeNeedsProvince = false;
+        }
+        else if (Depth() == 2 && isObject && Key() == "city") cityNeedsName = true;
+        else if (Depth() == 3 && isObject && path[1] == "city" && Key() == "commune") communeNeedsProvince = true;
+        return true;
+    }
+
+    bool Leave(bool isObject) override {
+        if (Depth() == 1 && isObject) {
+            if (hasId && hasName && !bad && !cityNeedsName && !communeNeedsProvince) out.push_back(std::move(cur));
+            else ++skipped;
+        }
+        return true;
+    }
+
+    bool Value(const SaxScalar& v) override {
+        if (Depth() == 0) return Fail("Oczekiwano tablicy stacji");
+        if (Depth() == 2) {
+            const auto& k = Key();
+            if (k == "id") {
+                if (v.kind == SaxScalar::Number) { cur.id = static_cast<int>(v.number); hasId = true; }
+                else bad = true;
+            }
+            else if (k == "stationName") {
+                if (v.kind == SaxScalar::String) { cur.name = *v.text; hasName = true; }
+                else bad = true;
+            }
+            else if (k == "gegrLat") cur.lat = Coordinate(v);
+            else if (k == "gegrLon") cur.lon = Coordinate(v);
+        }
+        else if (Depth() == 3 && path[1] == "city" && Key() == "name") {
+            if (v.kind == SaxScalar::String) { cur.city = *v.text; cityNeedsName = false; }
+        }
+        else if (Depth() == 4 && path[1] == "city" && path[2] == "commune" && Key() == "provinceName") {
+            if (v.kind == SaxScalar::String) { cur.region = *v.text; communeNeedsProvince = false; }
+        }
+        return true;
+    }
+
+private:
+    /// Współrzędna jako liczba lub tekst; w razie błędu 0
+    static double Coordinate(const SaxScalar& v) {
+        if (v.kind == SaxScalar::Number) return v.number;
+        if (v.kind == SaxScalar::String) {
+            try { return std::stod(*v.text); }
+            catch (...) { return 0.0; }
+        }
+        return 0.0;
+    }
+
+    Station cur;
+    bool hasId = false, hasName = false, bad = false;
+    bool cityNeedsName = false, communeNeedsProvince = false;
+};
+
+/// Handler SAX odpowiedzi station/sensors – wypełnia Sensor w jednym przebiegu
+class SensorListSax : public JsonPathSax {
+public:
+    std::vector<Sensor> out;
+
+protected:
+    bool Enter(bool isObject) override {
+        if (Depth() == 0 && isObject) return Fail("Oczekiwano tablicy w odpowiedzi");
+        if (Depth() == 1 && isObject) {
+            cur = Sensor();
+            cur.name = "Brak danych";
+            hasId = false;
+        }
+        else if (Depth() == 2 && isObject && Key() == "param") cur.name = "Nieznany sensor";
+        return true;
+    }
+
+    bool Leave(bool isObject) override {
+        if (Depth() == 1 && isObject && hasId) out.push_back(std::move(cur));
+        return true;
+    }
+
+    bool Value(const SaxScalar& v) override {
+        if (Depth() == 0) return Fail("Oczekiwano tablicy w odpowiedzi");
+        if (Depth() == 2 && Key() == "id" && v.kind == SaxScalar::Number) {
+            cur.id = static_cast<int>(v.number);
+            hasId = true;
+        }
+        else if (Depth() == 3 && path[1] == "param" && Key() == "paramName" && v.kind == SaxScalar::String) {
+            cur.name = *v.text;
+        }
+        return true;
+    }
+
+private:
+    Sensor cur;
+    bool hasId = false;
+};
+
+/// Handler SAX odpowiedzi data/getData – waliduje pomiary i od razu buduje serię (czas, wartość).
+/// Wartości null oraz pomiary z nieczytelną datą są pomijane.
+class SensorDataSax : public JsonPathSax {
+public:
+    Series out;
+    bool hasKey = false, hasValues = false;
+
+protected:
+    bool Enter(bool isObject) override {
+        if (Depth() == 0 && !isObject) return Fail("Oczekiwano obiektu w odpowiedzi");
+        if (Depth() == 1 && Key() == "values") {
+            if (isObject) return Fail("Brak lub nieprawidłowy klucz 'values' w odpowiedzi");
+            hasValues = true;
+        }
+        else if (Depth() == 2 && path[0] == "values") {
+            if (!isObject) return Fail("Nieprawidłowy pomiar");
+            hasDate = hasValue = isNull = false;
+        }
+        return true;
+    }
+
+    bool Leave(bool isObject) override {
+        if (Depth() == 2 && path[0] == "values" && isObject) {
+            if (!hasDate) return Fail("Brak daty w pomiarze");
+            if (!hasValue) return Fail("Brak wartości w pomiarze");
+            if (!isNull && dateOk) out.emplace_back(time, value);
+        }
+        return true;
+    }
+
+    bool Value(const SaxScalar& v) override {
+        if (Depth() == 0) return Fail("Oczekiwano obiektu w odpowiedzi");
+        if (Depth() == 1) {
+            if (Key() == "key") {
+                if (v.kind != SaxScalar::String) return Fail("Brak lub nieprawidłowy klucz 'key' w odpowiedzi");
+                hasKey = true;
+            }
+            else if (Key() == "values") return Fail("Brak lub nieprawidłowy klucz 'values' w odpowiedzi");
+        }
+        else if (Depth() == 3 && path[0] == "values") {
+            if (Key() == "date") {
+                if (v.kind != SaxScalar::String) return Fail("Brak daty w pomiarze");
+                hasDate = true;
+                dateOk = ParseGiosDate(*v.text, time);
+            }
+            else if (Key() == "value") {
+                if (v.kind != SaxScalar::Number && v.kind != SaxScalar::Null)
+                    return Fail("Nieprawidłowy typ wartości w pomiarze");
+                hasValue = true;
+                isNull = v.kind == SaxScalar::Null;
+                value = v.number;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool hasDate = false, hasValue = false, isNull = false, dateOk = false;
+    system_clock::time_point time;
+    double value = 0;
+};
+
+/// Pobiera wszystkie stacje AQI z API
+std::vector<Station> FetchAll() {
+    std::ofstream error_log("error_log.txt", std::ios::app); // Plik do logowania błędów
+
+    try {
+        // Pobierz odpowiedź z API
+        // Pobierz odpowiedź z API, parsując JSON w trakcie pobierania prosto do struktur Station
+        StationListSax sax = HttpCache::Instance().GetParsed<StationListSax>(L"api.gios.gov.pl", L"/pjp-api/rest/station/findAll");
+        if (sax.skipped > 0) {
+            error_log << "Pominięto stacje z niepełnymi danymi: " << sax.skipped << "\n";
+        }
+        if (sax.out.empty()) {
+            error_log << "Nie znaleziono poprawnych stacji\n";
+            throw std::runtime_error("Nie znaleziono żadnych poprawnych stacji");
+        }
+        return std::move(sax.out);
+    }
+    catch (const std::exception& e) {
+        error_log << "Błąd FetchAll: " << e.what() << "\n";
+        throw NetworkException("Nie można pobrać stacji: " + std::string(e.what()));
+    }
+}
+
+//******************************************************************************************
+// Katalog stacji
+//******************************************************************************************
+
+/// Normalizuje tekst UTF-8 do klucza wyszukiwania: małe litery, polskie znaki bez diakrytyków
+std::string FoldKey(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c < 0x80) {
+            out += static_cast<char>(tolower(c));
+            continue;
+        }
+        if (i + 1 < s.size()) {
+            unsigned code = (c << 8) | static_cast<unsigned char>(s[i + 1]);
+            char folded = 0;
+            switch (code) {
+            case 0xC484: case 0xC485: folded = 'a'; break;  // Ą ą
+            case 0xC486: case 0xC487: folded = 'c'; break;  // Ć ć
+            case 0xC498: case 0xC499: folded = 'e'; break;  // Ę ę
+            case 0xC581: case 0xC582: folded = 'l'; break;  // Ł ł
+            case 0xC583: case 0xC584: folded = 'n'; break;  // Ń ń
+            case 0xC393: case 0xC3B3: folded = 'o'; break;  // Ó ó
+            case 0xC59A: case 0xC59B: folded = 's'; break;  // Ś ś
+            case 0xC5B9: case 0xC5BA:                       // Ź ź
+            case 0xC5BB: case 0xC5BC: folded = 'z'; break;  // Ż ż
+            }
+            if (folded) {
+                out += folded;
+                ++i;
+                continue;
+            }
+        }
+        out += static_cast<char>(c);
+    }
+    return out;
+}
+
+/// Drzewo k-d nad współrzędnymi stacji (szerokość/długość w stopniach), przechowywane niejawnie w tablicy:
+/// węzłem zakresu [lo, hi) jest element środkowy, lewe poddrzewo to [lo, mid), prawe (mid, hi).
+/// Zapytania odcinają poddrzewa tanim ograniczeniem (prostokąt/dolne ograniczenie odległości),
+/// a dokładna odległość liczona jest tylko dla punktów, które przeszły ten filtr – w zapytaniu
+/// o promień jednym przebiegiem HaversineBatch, w k-NN ze składnika haversine (HavTerm).
+class StationKdTree {
+public:
+    StationKdTree() = default;
+
+    explicit StationKdTree(const std::vector<Station>& stations) {
+        nodes.reserve(stations.size());
+        double maxAbsLat = 0;
+        for (size_t i = 0; i < stations.size(); ++i) {
+            const auto& s = stations[i];
+            nodes.push_back({ s.lat, s.lon, GeoTrig::Of(s.lat, s.lon), i });
+            maxAbsLat = std::max(maxAbsLat, std::fabs(s.lat));
+        }
+        maxAbsLatitude = maxAbsLat;
+        Build(0, nodes.size(), 0);
+    }
+
+    /// Indeksy stacji w promieniu km od punktu (lat, lon)
+    std::vector<size_t> WithinRadius(double lat, double lon, double km) const {
+        std::vector<size_t> out;
+        if (nodes.empty()) return out;
+        // Prostokąt ograniczający: dφ <= d/R, a sin(dλ/2) <= sin(d/2R) / cos(φ) dla skrajnej szerokości koła
+        const double angle = km / EARTH_RADIUS_KM;
+        const double dLat = angle * 180.0 / PI;
+        const double edgeLat = std::min(89.9, std::fabs(lat) + dLat);
+        const double dLon = 2 * asin(std::min(1.0, sin(angle / 2) / cos(Deg2Rad(edgeLat)))) * 180.0 / PI;
+        const Box box{ lat - dLat, lat + dLat, lon - dLon, lon + dLon };
+        std::vector<size_t> candidates;   // pozycje węzłów wewnątrz prostokąta
+        Radius(0, nodes.size(), 0, box, candidates);
+
+        // Dokładny test odległości dla kandydatów – wsadowo, na kolumnach SoA
+        GeoPointsSoA pts;
+        pts.Reserve(candidates.size());
+        for (size_t c : candidates)
+            pts.Add(nodes[c].trig);
+        std::vector<double> distKm(candidates.size());
+        HaversineBatch(lat, lon, pts, distKm.data());
+        for (size_t k = 0; k < candidates.size(); ++k)
+            if (distKm[k] <= km)
+                out.push_back(nodes[candidates[k]].index);
+        return out;
+    }
+
+    /// k najbliższych stacji (odległość w km, indeks stacji), posortowanych rosnąco po odległości
+    std::vector<std::pair<double, size_t>> Nearest(double lat, double lon, size_t k) const {
+        std::vector<std::pair<double, size_t>> heap;   // kopiec maksymalny po składniku haversine
+        if (nodes.empty() || k == 0) return heap;
+        const double cosMin = cos(Deg2Rad(std::min(89.9, std::max(maxAbsLatitude, std::fabs(lat)))));
+        Knn(0, nodes.size(), 0, Query(lat, lon), k, cosMin * cosMin, heap);
+        std::sort_heap(heap.begin(), heap.end());
+        for (auto& h : heap)
+            h.first = HavTermToKm(h.first);
+        return heap;
+    }
+
+private:
+    struct Node {
+        double lat, lon;
+        GeoTrig trig;
+        size_t index;
+    };
+    struct Box {
+        double minLat, maxLat, minLon, maxLon;
+    };
+
+    static Node Query(double lat, double lon) {
+        return { lat, lon, GeoTrig::Of(lat, lon), 0 };
+    }
+    static double Hav(const Node& a, const Node& b) { return HavTerm(a.trig, b.trig); }
+    static double Coord(const Node& n, int axis) { return axis == 0 ? n.lat : n.lon; }
+
+    void Build(size_t lo, size_t hi, int axis) {
+        if (hi - lo < 2) return;
+        size_t mid = lo + (hi - lo) / 2;
+        std::nth_element(nodes.begin() + lo, nodes.begin() + mid, nodes.begin() + hi,
+            [axis](const Node& a, const Node& b) { return Coord(a, axis) < Coord(b, axis); });
+        Build(lo, mid, axis ^ 1);
+        Build(mid + 1, hi, axis ^ 1);
+    }
+
+    /// Zbiera pozycje węzłów leżących w prostokącie box
+    void Radius(size_t lo, size_t hi, int axis, const Box& box, std::vector<size_t>& out) const {
+        if (lo >= hi) return;
+        size_t mid = lo + (hi - lo) / 2;
+        const Node& n = nodes[mid];
+        if (n.lat >= box.minLat && n.lat <= box.maxLat && n.lon >= box.minLon && n.lon <= box.maxLon)
+            out.push_back(mid);
+        const double split = Coord(n, axis);
+        if ((axis == 0 ? box.minLat : box.minLon) <= split)
+            Radius(lo, mid, axis ^ 1, box, out);
+        if ((axis == 0 ? box.maxLat : box.maxLon) >= split)
+            Radius(mid + 1, hi, axis ^ 1, box, out);
+    }
+
+    /// Dolne ograniczenie składnika haversine dla dowolnego punktu po drugiej stronie płaszczyzny podziału:
+    /// a >= hav(dφ) oraz a >= cos²(φmax)·hav(dλ)
+    static double PlaneHavBound(int axis, double delta, double cosMin2) {
+        double s = sin(std::min(Deg2Rad(std::fabs(delta)), PI) / 2);
+        return axis == 0 ? s * s : cosMin2 * s * s;
+    }
+
+    void Knn(size_t lo, size_t hi, int axis, const Node& q, size_t k, double cosMin2,
+        std::vector<std::pair<double, size_t>>& heap) const {
+        if (lo >= hi) return;
+        size_t mid = lo + (hi - lo) / 2;
+        const Node& n = nodes[mid];
+        const double a = Hav(q, n);
+        if (heap.size() < k || a < heap.front().first) {
+            if (heap.size() == k) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.pop_back();
+            }
+            heap.emplace_back(a, n.index);
+            std::push_heap(heap.begin(), heap.end());
+        }
+        const double delta = Coord(q, axis) - Coord(n, axis);
+        const bool leftFirst = delta < 0;
+        if (leftFirst) Knn(lo, mid, axis ^ 1, q, k, cosMin2, heap);
+        else Knn(mid + 1, hi, axis ^ 1, q, k, cosMin2, heap);
+        if (heap.size() < k || PlaneHavBound(axis, delta, cosMin2) < heap.front().first) {
+            if (leftFirst) Knn(mid + 1, hi, axis ^ 1, q, k, cosMin2, heap);
+            else Knn(lo, mid, axis ^ 1, q, k, cosMin2, heap);
+        }
+    }
+
+    std::vector<Node> nodes;
+    double maxAbsLatitude = 0;
+};
+
+/// Katalog wszystkich stacji, budowany z odpowiedzi station/findAll i odświeżany przy każdym
+/// pobraniu pełnej listy. Udostępnia indeks po id, indeks po mieście (bez rozróżniania wielkości
+/// liter i polskich znaków), wyszukiwanie po prefiksie nazwy/miasta dla podpowiedzi
+/// oraz indeks przestrzenny dla zapytań o promień i najbliższe stacje.
+class StationCatalog {
+public:
+    explicit StationCatalog(std::vector<Station> all) : stations(std::move(all)) {
+        for (size_t i = 0; i < stations.size(); ++i) {
+            const auto& s = stations[i];
+            byId.emplace(s.id, i);
+            std::string city = FoldKey(s.city);
+            byCity[city].push_back(i);
+            prefixKeys.emplace_back(city, i);
+            prefixKeys.emplace_back(FoldKey(s.name), i);
+        }
+        std::sort(prefixKeys.begin(), prefixKeys.end());
+        spatial = StationKdTree(stations);
+    }
+
+    /// Zwraca bieżący katalog; pierwsze wywołanie pobiera listę stacji (FetchAll)
+    static std::shared_ptr<const StationCatalog> Get() {
+        auto& slot = Slot();
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        if (!slot.instance)
+            slot.instance = std::make_shared<const StationCatalog>(FetchAll());
+        return slot.instance;
+    }
+
+    /// Pobiera listę stacji ponownie i podmienia bieżący katalog; wcześniej wydane katalogi
+    /// pozostają ważne do zwolnienia przez ich użytkowników
+    static std::shared_ptr<const StationCatalog> Refresh() {
+        auto fresh = std::make_shared<const StationCatalog>(FetchAll());
+        auto& slot = Slot();
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.instance = fresh;
+        return fresh;
+    }
+
+    const std::vector<Station>& All() const { return stations; }
+
+    /// Stacja o podanym id, lub nullptr
+    const Station* Find(int id) const {
+        auto it = byId.find(id);
+        return it != byId.end() ? &stations[it->second] : nullptr;
+    }
+
+    std::vector<Station> ByCity(const std::string& city) const { return Collect(byCity, city); }
+
+    /// Stacje w promieniu km od punktu
+    std::vector<Station> WithinRadius(double lat, double lon, double km) const {
+        std::vector<Station> out;
+        auto hits = spatial.WithinRadius(lat, lon, km);
+        std::sort(hits.begin(), hits.end());   // kolejność jak w katalogu
+        for (size_t i : hits)
+            out.push_back(stations[i]);
+        return out;
+    }
+
+    /// k najbliższych stacji wraz z odległością w km, od najbliższej
+    std::vector<std::pair<double, const Station*>> Nearest(double lat, double lon, size_t k) const {
+        std::vector<std::pair<double, const Station*>> out;
+        for (const auto& [km, i] : spatial.Nearest(lat, lon, k))
+            out.emplace_back(km, &stations[i]);
+        return out;
+    }
+
+    /// Stacje, których miasto lub nazwa zaczyna się od prefix (najwyżej limit wyników)
+    std::vector<const Station*> PrefixSearch(const std::string& prefix, size_t limit) const {
+        std::vector<const Station*> out;
+        std::vector<bool> seen(stations.size());
+        const std::string key = FoldKey(prefix);
+        for (auto it = LowerBound(key); it != prefixKeys.end() && out.size() < limit; ++it) {
+            if (it->first.compare(0, key.size(), key) != 0)
+                break;
+            if (seen[it->second]) continue;
+            seen[it->second] = true;
+            out.push_back(&stations[it->second]);
+        }
+        return out;
+    }
+
+private:
+    using Index = std::unordered_map<std::string, std::vector<size_t>>;
+
+    struct InstanceSlot {
+        std::mutex mutex;
+        std::shared_ptr<const StationCatalog> instance;
+    };
+    static InstanceSlot& Slot() {
+        static InstanceSlot slot;
+        return slot;
+    }
+
+    std::vector<Station> Collect(const Index& index, const std::string& key) const {
+        std::vector<Station> out;
+        auto it = index.find(FoldKey(key));
+        if (it == index.end()) return out;
+        out.reserve(it->second.size());
+        for (size_t i : it->second)
+            out.push_back(stations[i]);
+        return out;
+    }
+
+    /// Pierwszy klucz >= key (key musi być już znormalizowany przez FoldKey)
+    std::vector<std::pair<std::string, size_t>>::const_iterator LowerBound(const std::string& key) const {
+        return std::lower_bound(prefixKeys.begin(), prefixKeys.end(), std::make_pair(key, size_t(0)));
+    }
+
+    std::vector<Station> stations;
+    std::unordered_map<int, size_t> byId;
+    Index byCity;
+    std::vector<std::pair<std::string, size_t>> prefixKeys;  // posortowane (klucz, indeks stacji)
+    StationKdTree spatial;
+};
+
+/// Pobiera stacje według nazwy miasta
+std::vector<Station> FetchByCity(const std::string& city) {
+    return StationCatalog::Get()->ByCity(city);
+}
+
+/// Pobiera stacje w obrębie określonego promienia od danego adresu. Gdy w promieniu nie ma
+/// żadnej stacji, a podano nearestOnly, zwraca najbliższe (kRadiusFallback) i ustawia *nearestOnly –
+/// wywołujący musi je wtedy oznaczyć jako spoza promienia; bez nearestOnly wynik jest pusty
+std::vector<Station> FetchByRadius(const std::string& addr, int km, bool* nearestOnly = nullptr) {
+    constexpr size_t kRadiusFallback = 3;
+    auto center = Geocode(addr);
+    auto catalog = StationCatalog::Get();
+    std::vector<Station> out = catalog->WithinRadius(center.first, center.second, km);
+    if (nearestOnly) *nearestOnly = false;
+    if (out.empty() && nearestOnly) {
+        for (const auto& hit : catalog->Nearest(center.first, center.second, kRadiusFallback))
+            out.push_back(*hit.second);
+        *nearestOnly = !out.empty();
+    }
+    return out;
+}
+
+/// Pobiera sensory danej stacji
+std::vector<Sensor> FetchSensors(int sid) {
+    std::string path = "/pjp-api/rest/station/sensors/" + std::to_string(sid);
+    std::wstring wpath(path.begin(), path.end());
+    std::string resp;
+    SensorListSax sax;
+    try {
+        sax = HttpCache::Instance().GetParsed<SensorListSax>(L"api.gios.gov.pl", wpath, &resp);
+        std::ofstream("last_sensors.json") << resp; // DEBUG
+    }
+    catch (const std::exception& e) {
+        throw NetworkException("Błąd połączenia: " + std::string(e.what()));
+    }
+    if (sax.out.empty()) {
+        throw NetworkException("Brak dostępnych sensorów");
+    }
+    return std::move(sax.out);
+}
+
+/// Pobiera dane historyczne dla danego sensora jako serię posortowaną rosnąco po czasie
+Series FetchData(int sensorId) {
+    std::string path = "/pjp-api/rest/data/getData/" + std::to_string(sensorId);
+    std::wstring wpath(path.begin(), path.end());
+    try {
+        std::string raw_response;
+        SensorDataSax sax = HttpCache::Instance().GetParsed<SensorDataSax>(L"api.gios.gov.pl", wpath, &raw_response);
+        std::ofstream("last_sensor_data.json") << raw_response; // DEBUG
+        if (!sax.hasKey) {
+            throw NetworkException("Brak lub nieprawidłowy klucz 'key' w odpowiedzi");
+        }
+        if (!sax.hasValues) {
+            throw NetworkException("Brak lub nieprawidłowy klucz 'values' w odpowiedzi");
+        }
+        // GIOS zwraca pomiary od najnowszego – zwykle wystarczy odwrócić kolejność
+        auto& out = sax.out;
+        auto byTime = [](const auto& a, const auto& b) { return a.first < b.first; };
+        if (!std::is_sorted(out.begin(), out.end(), byTime)) {
+            std::reverse(out.begin(), out.end());
+            if (!std::is_sorted(out.begin(), out.end(), byTime))
+                std::sort(out.begin(), out.end(), byTime);
+        }
+        return std::move(out);
+    }
+    catch (const NetworkException&) {
+        throw;
+    }
+    catch (const std::exception& e) {
+        throw NetworkException("Nieznany błąd: " + std::string(e.what()));
+    }
+}
+
+//******************************************************************************************
+// Publikacja danych stacji
+//******************************************************************************************
+
+/// Niezmienna wersja listy stacji. Kolejne wersje współdzielą niezmienione stacje
+/// (shared_ptr<const Station>), więc zmiana jednej stacji kopiuje tylko ją i tablicę wskaźników
+struct StationSnapshot {
+    std::vector<std::shared_ptr<const Station>> stations;
+    std::unordered_map<int, size_t> index;   // id stacji -> pozycja na liście
+    uint64_t version = 0;
+
+    size_t Size() const { return stations.size(); }
+    const Station& operator[](size_t i) const { return *stations[i]; }
+
+    /// Pozycja stacji o podanym id albo -1
+    int Find(int id) const {
+        auto it = index.find(id);
+        return it != index.end() ? static_cast<int>(it->second) : -1;
+    }
+
+    /// Buduje wersję z nowej listy stacji (może działać poza wątkiem UI)
+    static std::shared_ptr<StationSnapshot> Build(std::vector<Station> all) {
+        auto snap = std::make_shared<StationSnapshot>();
+        snap->stations.reserve(all.size());
+        for (auto& s : all) {
+            snap->index[s.id] = snap->stations.size();
+            snap->stations.push_back(std::make_shared<const Station>(std::move(s)));
+        }
+        return snap;
+    }
+};
+
+/// Bieżąca wersja danych stacji publikowana w stylu RCU: czytelnicy pobierają ją przez atomic_load
+/// i pracują na niezmiennej wersji bez blokad, a piszący budują nową wersję i podmieniają wskaźnik
+/// przez compare-exchange (przy konflikcie zmiana jest nakładana ponownie na nowszą wersję)
+class StationStore {
+public:
+    static StationStore& Instance() {
+        static StationStore store;
+        return store;
+    }
+
+    std::shared_ptr<const StationSnapshot> Current() const { return std::atomic_load(&current); }
+
+    /// Zastępuje całą listę wersją zbudowaną wcześniej (np. w wątku pobierającym)
+    void Publish(std::shared_ptr<StationSnapshot> next) {
+        Commit([&](const StationSnapshot&) { return next; });
+    }
+
+    /// Kopiuje stację o podanym id, modyfikuje kopię i publikuje ją; zwraca nową wersję stacji
+    /// albo nullptr, jeśli stacji nie ma na liście
+    std::shared_ptr<const Station> Update(int id, const std::function<void(Station&)>& edit) {
+        std::shared_ptr<const Station> updated;
+        Commit([&](const StationSnapshot& cur) -> std::shared_ptr<StationSnapshot> {
+            const int pos = cur.Find(id);
+            if (pos < 0) {
+                updated.reset();
+                return nullptr;
+            }
+            auto station = std::make_shared<Station>(cur[pos]);
+            edit(*station);
+            updated = station;
+            auto next = std::make_shared<StationSnapshot>(cur);
+            next->stations[pos] = std::move(station);
+            return next;
+        });
+        return updated;
+    }
+
+    /// Podmienia stację o tym samym id albo dopisuje ją na końcu listy
+    void Upsert(Station station) {
+        auto shared = std::make_shared<const Station>(std::move(station));
+        Commit([&](const StationSnapshot& cur) {
+            auto next = std::make_shared<StationSnapshot>(cur);
+            const int pos = cur.Find(shared->id);
+            if (pos >= 0)
+                next->stations[pos] = shared;
+            else {
+                next->index[shared->id] = next->stations.size();
+                next->stations.push_back(shared);
+            }
+            return next;
+        });
+    }
+
+private:
+    StationStore() : current(std::make_shared<const StationSnapshot>()) {}
+
+    /// Pętla RCU: make buduje nową wersję z bieżącej (nullptr = brak zmian)
+    template <typename Make>
+    void Commit(Make make) {
+        auto cur = std::atomic_load(&current);
+        while (true) {
+            std::shared_ptr<StationSnapshot> next = make(*cur);
+            if (!next) return;
+            next->version = cur->version + 1;
+            std::shared_ptr<const StationSnapshot> published = next;
+            if (std::atomic_compare_exchange_strong(&current, &cur, published))
+                return;
+        }
+    }
+
+    std::shared_ptr<const StationSnapshot> current;
+};
+
+//******************************************************************************************
+// Asynchroniczne pobieranie danych
+//******************************************************************************************
+
+/// Kolejka zakończeń – wątki robocze odkładają do niej wywołania zwrotne,
+/// a pętla renderowania wykonuje je w wątku UI raz na klatkę.
+/// Każde Post sygnalizuje zdarzenie budzące, na którym czeka bezczynna pętla komunikatów
+class CompletionQueue {
+public:
+    CompletionQueue() : wakeEvent(CreateEvent(nullptr, FALSE, FALSE, nullptr)) {}
+    ~CompletionQueue() {
+        if (wakeEvent)
+            CloseHandle(wakeEvent);
+    }
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    void Post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(fn));
+        }
+        if (wakeEvent)
+            SetEvent(wakeEvent);
+    }
+
+    /// Zdarzenie (auto-reset) sygnalizowane po każdym Post
+    HANDLE WakeHandle() const { return wakeEvent; }
+
+    /// Wykonuje wszystkie oczekujące wywołania; zwraca true, jeśli cokolwiek wykonano
+    bool Drain() {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.swap(pending);
+        }
+        for (auto& fn : ready)
+            fn();
+        return !ready.empty();
+    }
+
+private:
+    HANDLE wakeEvent;
+    std::mutex mutex;
+    std::vector<std::function<void()>> pending;
+};
+
+CompletionQueue ui_queue;
+
+/// Priorytet zadania puli: pobrania widoczne w UI wyprzedzają prefetch i prace porządkowe
+enum class TaskPriority { High = 0, Normal = 1, Low = 2 };
+
+template <typename T>
+class Task;
+
+/// Pula wątków z kradzieżą zadań. Każdy wątek ma własne kolejki (po jednej na priorytet): zadania
+/// zlecone z wnętrza puli trafiają do kolejki bieżącego wątku, pozostałe do kolejki wspólnej.
+/// Wątek bierze najpierw najwyższy priorytet: ze swojej kolejki od końca (LIFO), z kolejki wspólnej,
+/// a na końcu kradnie od początku kolejek innych wątków
+class TaskScheduler {
+public:
+    static TaskScheduler& Instance() {
+        static TaskScheduler scheduler;
+        return scheduler;
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    ~TaskScheduler() {
+        Shutdown();
+    }
+
+    /// Zatrzymuje pulę: odrzuca zadania czekające w kolejkach i czeka na zakończenie bieżących.
+    /// Wywoływane przy zamykaniu aplikacji, po anulowaniu trwających żądań, zanim zostaną zniszczone
+    /// singletony używane przez zadania (HttpConnectionPool, SeriesJournal). Kolejne Submit są ignorowane
+    void Shutdown() {
+        std::array<std::deque<Job>, kPriorities> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+            stopping = true;
+            dropped.swap(injected);
+        }
+        cv.notify_all();
+        for (auto& w : workers) {
+            std::array<std::deque<Job>, kPriorities> local;
+            {
+                std::lock_guard<std::mutex> lock(w->mutex);
+                local.swap(w->local);
+            }
+        }
+        for (auto& w : workers)
+            if (w->thread.joinable())
+                w->thread.join();
+        queued = 0;
+    }
+
+    /// Zleca fn; zadanie, którego token anulowano przed startem, jest pomijane
+    void Submit(std::function<void()> fn, TaskPriority priority = TaskPriority::Normal, CancellationToken token = {}) {
+        if (stopping) return;
+        Job job{ std::move(fn), std::move(token) };
+        const size_t p = static_cast<size_t>(priority);
+        // Licznik rośnie pod tą samą blokadą co kolejka: wątek, który zdejmie zadanie, zmniejszy go dopiero potem
+        if (workerOwner == this) {
+            Worker& self = *workers[workerIndex];
+            std::lock_guard<std::mutex> lock(self.mutex);
+            self.local[p].push_back(std::move(job));
+            ++queued;
+        }
+        else {
+            std::lock_guard<std::mutex> lock(mutex);
+            injected[p].push_back(std::move(job));
+            ++queued;
+        }
+        {
+            // Pusta sekcja krytyczna: wątek między sprawdzeniem predykatu a uśpieniem nie przegapi powiadomienia
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        cv.notify_one();
+    }
+
+    /// Zleca work i zwraca uchwyt wyniku, do którego można dopisać kontynuacje
+    template <typename T>
+    Task<T> Run(std::function<T()> work, TaskPriority priority = TaskPriority::Normal, CancellationToken token = {});
+
+private:
+    static constexpr size_t kPriorities = 3;
+
+    struct Job {
+        std::function<void()> fn;
+        CancellationToken token;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::array<std::deque<Job>, kPriorities> local;
+        std::thread thread;
+    };
+
+    TaskScheduler() {
+        // Zadania to głównie blokujące zapytania HTTP, więc wątków nie mniej niż jednoczesnych pobrań
+        const size_t count = std::max<size_t>(4, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < count; ++i)
+            workers.push_back(std::make_unique<Worker>());
+        for (size_t i = 0; i < count; ++i)
+            workers[i]->thread = std::thread([this, i]() { WorkerLoop(i); });
+    }
+
+    void WorkerLoop(size_t index) {
+        workerOwner = this;
+        workerIndex = index;
+        while (!stopping) {
+            Job job;
+            if (TryPop(index, job)) {
+                --queued;
+                if (!job.token.IsCancelled()) {
+                    CancellationScope scope(job.token);
+                    job.fn();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return stopping || queued.load() > 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+    bool TryPop(size_t index, Job& out) {
+        for (size_t p = 0; p < kPriorities; ++p) {
+            {
+                Worker& self = *workers[index];
+                std::lock_guard<std::mutex> lock(self.mutex);
+                if (!self.local[p].empty()) {
+                    out = std::move(self.local[p].back());
+                    self.local[p].pop_back();
+                    return true;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!injected[p].empty()) {
+                    out = std::move(injected[p].front());
+                    injected[p].pop_front();
+                    return true;
+                }
+            }
+            for (size_t k = 1; k < workers.size(); ++k) {
+                Worker& victim = *workers[(index + k) % workers.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.local[p].empty()) {
+                    out = std::move(victim.local[p].front());
+                    victim.local[p].pop_front();
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;   // chroni injected, stopping i oczekiwanie na cv
+    std::condition_variable cv;
+    std::array<std::deque<Job>, kPriorities> injected;
+    std::atomic<size_t> queued{ 0 };
+    std::atomic<bool> stopping{ false };   // zmieniany pod mutex, czytany także bez blokady
+
+    inline static thread_local TaskScheduler* workerOwner = nullptr;
+    inline static thread_local size_t workerIndex = 0;
+};
+
+/// Wywołanie zwrotne przyjmujące wynik zadania (bez argumentu dla zadań bez wyniku)
+template <typename T>
+struct TaskCallback { using type = std::function<void(T)>; };
+template <>
+struct TaskCallback<void> { using type = std::function<void()>; };
+
+/// Wynik zadania zleconego przez TaskScheduler::Run. Kontynuacje uruchamiane są po zakończeniu
+/// zadania (od razu, jeśli już się zakończyło); błąd zadania pomija kolejne kroki łańcucha i trafia
+/// do onError. Zadanie anulowane przed startem kończy się jako anulowane – kolejne kroki są pomijane,
+/// a ThenOnUi nie wywołuje niczego. Task<void> nie niesie wyniku: jego kontynuacje nie przyjmują argumentu
+template <typename T>
+class Task {
+    /// Typ przechowywanego wyniku (Task<void> zapamiętuje tylko fakt zakończenia)
+    struct NoValue {};
+    using Stored = std::conditional_t<std::is_void_v<T>, NoValue, T>;
+
+    /// Typ wyniku kontynuacji fn wywołanej z wynikiem tego zadania
+    template <typename F, typename U = T>
+    struct ResultOf { using type = std::invoke_result_t<F, U>; };
+    template <typename F>
+    struct ResultOf<F, void> { using type = std::invoke_result_t<F>; };
+
+public:
+    Task(TaskPriority priority, CancellationToken token) : state(std::make_shared<State>()) {
+        state->priority = priority;
+        state->token = std::move(token);
+    }
+
+    /// Kontynuacja w puli: fn(wynik) jako kolejne zadanie z tym samym priorytetem i tokenem
+    template <typename F>
+    Task<typename ResultOf<F>::type> Then(F fn) const {
+        using R = typename ResultOf<F>::type;
+        Task<R> next(state->priority, state->token);
+        auto src = state;
+        OnComplete([src, next, fn]() {
+            if (src->cancelled) {
+                next.Cancel();
+                return;
+            }
+            if (src->failed) {
+                next.Fail(src->error);
+                return;
+            }
+            TaskScheduler::Instance().Submit([src, next, fn]() {
+                CancellationScope scope(src->token);
+                if (src->token.IsCancelled())
+                    next.Cancel();
+                else
+                    next.Execute([&]() { return Invoke(fn, *src); });
+                }, src->priority);
+            });
+        return next;
+    }
+
+    /// Kontynuacja w wątku UI (przez ui_queue); wynik anulowanego w międzyczasie żądania jest odrzucany
+    void ThenOnUi(typename TaskCallback<T>::type onDone, std::function<void(const std::string&)> onError) const {
+        auto src = state;
+        OnComplete([src, onDone = std::move(onDone), onError = std::move(onError)]() {
+            if (src->cancelled) return;
+            ui_queue.Post([src, onDone, onError]() {
+                if (src->token.IsCancelled()) return;
+                if (src->failed) {
+                    if (onError) onError(src->error);
+                }
+                else if (onDone) {
+                    Invoke(onDone, *src);
+                }
+                });
+            });
+    }
+
+private:
+    template <typename U>
+    friend class Task;
+    friend class TaskScheduler;
+
+    struct State {
+        std::mutex mutex;
+        bool done = false;
+        bool failed = false;
+        bool cancelled = false;
+        std::optional<Stored> value;
+        std::string error;
+        std::vector<std::function<void()>> continuations;
+        TaskPriority priority = TaskPriority::Normal;
+        CancellationToken token;
+    };
+
+    /// Wywołuje fn z wynikiem zadania (bez argumentu dla Task<void>)
+    template <typename F>
+    static decltype(auto) Invoke(F& fn, State& done) {
+        if constexpr (std::is_void_v<T>)
+            return fn();
+        else
+            return fn(*done.value);
+    }
+
+    template <typename Work>
+    void Execute(Work&& work) const {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                work();
+                Finish([&]() { state->value.emplace(); });
+            }
+            else {
+                T result = work();
+                Finish([&]() { state->value.emplace(std::move(result)); });
+            }
+        }
+        catch (const std::exception& e) {
+            // Błąd po anulowaniu (np. przerwane zapytanie HTTP) to skutek anulowania, nie błąd do zgłoszenia
+            if (state->token.IsCancelled())
+                Cancel();
+            else
+                Fail(e.what());
+        }
+    }
+
+    void Cancel() const {
+        Finish([&]() { state->cancelled = true; });
+    }
+
+    void Fail(const std::string& what) const {
+        Finish([&]() {
+            state->failed = true;
+            state->error = what;
+            });
+    }
+
+    template <typename Store>
+    void Finish(Store store) const {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            store();
+            state->done = true;
+            ready.swap(state->continuations);
+        }
+        for (auto& fn : ready)
+            fn();
+    }
+
+    void OnComplete(std::function<void()> fn) const {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->done) {
+                state->continuations.push_back(std::move(fn));
+                return;
+            }
+        }
+        fn();
+    }
+
+    std::shared_ptr<State> state;
+};
+
+template <typename T>
+Task<T> TaskScheduler::Run(std::function<T()> work, TaskPriority priority, CancellationToken token) {
+    Task<T> task(priority, std::move(token));
+    Submit([task, work = std::move(work)]() {
+        CancellationScope scope(task.state->token);
+        if (task.state->token.IsCancelled())
+            task.Cancel();
+        else
+            task.Execute(work);
+        }, priority);
+    return task;
+}
+
+/// Uruchamia work w puli zadań; wynik albo komunikat wyjątku trafia do wątku UI przez ui_queue.
+/// Po anulowaniu tokenu wynik jest odrzucany, a trwające zapytania HTTP przerywane
+template <typename T>
+void RunInBackground(std::function<T()> work, typename TaskCallback<T>::type onDone, std::function<void(const std::string&)> onError,
+    TaskPriority priority = TaskPriority::High, CancellationToken token = {}) {
+    TaskScheduler::Instance().Run<T>(std::move(work), priority, std::move(token)).ThenOnUi(std::move(onDone), std::move(onError));
+}
+
+/// Wykonuje fn(0..count-1) na co najwyżej maxParallel wątkach puli i czeka na zakończenie wszystkich.
+/// Wątek wywołujący sam przetwarza elementy, więc wywołanie z wnętrza zadania nie blokuje puli.
+/// Pierwszy wyjątek z fn jest rzucany ponownie po zakończeniu wszystkich pomocników; pozostałe elementy są wtedy pomijane
+void ParallelFor(size_t count, int maxParallel, const std::function<void(size_t)>& fn, TaskPriority priority = TaskPriority::Normal) {
+    if (count == 0) return;
+    struct Shared {
+        std::atomic<size_t> next{ 0 };
+        size_t count = 0;
+        size_t finished = 0;
+        const std::function<void(size_t)>* fn = nullptr;
+        std::atomic<bool> failed{ false };
+        std::exception_ptr error;   // pierwszy wyjątek z fn, chroniony przez mutex
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    auto shared = std::make_shared<Shared>();
+    shared->count = count;
+    shared->fn = &fn;
+    // Pomocnik, który wystartuje po rozdzieleniu wszystkich elementów, nie dotyka już fn.
+    // Pomocnicy dziedziczą token wywołującego, więc anulowanie przerywa też ich zapytania
+    auto drain = [shared, token = CancellationToken::Current()]() {
+        CancellationScope scope(token);
+        size_t ran = 0;
+        for (size_t i; (i = shared->next++) < shared->count; ++ran) {
+            if (shared->failed) continue;
+            try {
+                (*shared->fn)(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                if (!shared->error) shared->error = std::current_exception();
+                shared->failed = true;
+            }
+        }
+        if (ran == 0) return;
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->finished += ran;
+        if (shared->finished == shared->count)
+            shared->cv.notify_all();
+        };
+    const size_t helpers = std::min<size_t>(std::max(maxParallel, 1), count) - 1;
+    for (size_t h = 0; h < helpers; ++h)
+        TaskScheduler::Instance().Submit(drain, priority);
+    drain();
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->cv.wait(lock, [&]() { return shared->finished == shared->count; });
+    // Wyjątek zabierany ze stanu wspólnego: pomocnik zwalniający go później nie dotyka już obiektu wyjątku
+    std::exception_ptr error = std::move(shared->error);
+    lock.unlock();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+/// Silnik pobierania danych stacji: najpierw lista sensorów, potem serie getData
+/// wszystkich sensorów równolegle, z ograniczoną liczbą jednoczesnych zapytań.
+/// Wszystkie wywołania zwrotne wykonują się w wątku UI (przez ui_queue); po anulowaniu
+/// tokenu żądania nie są już wywoływane, a jego zapytania HTTP zostają przerwane.
+class StationFetchEngine {
+public:
+    static constexpr int kMaxParallel = 4;
+
+    struct Callbacks {
+        std::function<void(int stationId, const std::vector<Sensor>&)> onSensors;
+        std::function<void(int stationId, int sensorId, Series)> onSeries;
+        std::function<void(int stationId, int sensorId, const std::string&)> onSeriesError;
+        std::function<void(int stationId, const std::string&)> onError;
+        std::function<void(int stationId)> onDone;
+    };
+
+    /// Pobiera sensory stacji (priorytet wysoki), a następnie w tle dane historyczne każdego z nich.
+    /// Lista sensorów trafia do UI przed pierwszą serią: kontynuacja UI jest dopisana przed rozdzieleniem pobrań
+    void FetchStation(int stationId, Callbacks cb, CancellationToken token = {}) {
+        auto sensorsTask = TaskScheduler::Instance().Run<std::vector<Sensor>>(
+            [stationId]() { return FetchSensors(stationId); }, TaskPriority::High, token);
+        sensorsTask.ThenOnUi(
+            [cb, stationId](std::vector<Sensor> sensors) { if (cb.onSensors) cb.onSensors(stationId, sensors); },
+            [cb, stationId](const std::string& what) {
+                if (cb.onError) cb.onError(stationId, what);
+                if (cb.onDone) cb.onDone(stationId);
+            });
+        sensorsTask
+            .Then([stationId, cb, token](const std::vector<Sensor>& sensors) {
+                std::vector<int> ids;
+                for (const auto& s : sensors) ids.push_back(s.id);
+                FanOut(stationId, ids, cb, TaskPriority::Normal, token);
+            })
+            .ThenOnUi([cb, stationId]() { if (cb.onDone) cb.onDone(stationId); }, nullptr);
+    }
+
+    /// Pobiera w tle dane wskazanych sensorów (bez ponownego pobierania listy sensorów);
+    /// żądanie z UI wyprzedza trwający prefetch serii
+    void FetchSeries(int stationId, std::vector<int> sensorIds, Callbacks cb, CancellationToken token = {}) {
+        TaskScheduler::Instance().Submit([stationId, ids = std::move(sensorIds), cb = std::move(cb), token]() {
+            FanOut(stationId, ids, cb, TaskPriority::High, token);
+            PostIfCurrent(token, [cb, stationId]() { if (cb.onDone) cb.onDone(stationId); });
+        }, TaskPriority::High, token);
+    }
+
+private:
+    /// Przekazuje fn do wątku UI, o ile token nie został w międzyczasie anulowany
+    static void PostIfCurrent(const CancellationToken& token, std::function<void()> fn) {
+        if (token.IsCancelled()) return;
+        ui_queue.Post([token, fn = std::move(fn)]() {
+            if (!token.IsCancelled()) fn();
+            });
+    }
+
+    /// Rozdziela sensory między co najwyżej kMaxParallel wątków puli i czeka na ich zakończenie;
+    /// sensory jeszcze nierozpoczęte w chwili anulowania są pomijane
+    static void FanOut(int stationId, const std::vector<int>& ids, const Callbacks& cb, TaskPriority priority, const CancellationToken& token) {
+        ParallelFor(ids.size(), kMaxParallel, [&](size_t i) {
+            if (token.IsCancelled()) return;
+            int sensorId = ids[i];
+            try {
+                Series series = FetchData(sensorId);
+                PostIfCurrent(token, [cb, stationId, sensorId, series = std::move(series)]() {
+                    if (cb.onSeries) cb.onSeries(stationId, sensorId, series);
+                    });
+            }
+            catch (const std::exception& e) {
+                std::string what = e.what();
+                PostIfCurrent(token, [cb, stationId, sensorId, what]() {
+                    if (cb.onSeriesError) cb.onSeriesError(stationId, sensorId, what);
+                    });
+            }
+            }, priority);
+    }
+};
+
+//******************************************************************************************
+// Obsługa zapisu/odczytu danych lokalnych (DB)
+//******************************************************************************************
+
+/// Wczytuje dane stacji z podanego pliku
+bool LoadDB(const std::string& fn, std::vector<std::string>& dates, Station& station) {
+    std::ifstream in("savefiles/" + fn);
+    if (!in) return false;
+
+    try {
+        auto j = json::parse(in);
+        station = Station();
+        auto& station_data = j["station"];
+        station.id = station_data["id"];
+        station.name = station_data["stationName"];
+        station.city = station_data["city"];
+        station.region = station_data["region"];
+        station.lat = station_data["lat"];
+        station.lon = station_data["lon"];
+        dates = j["dates"].get<std::vector<std::string>>();
+
+        // Starsze pliki nie mają znaczników czasu – odtwarzamy je co godzinę, kończąc na ostatniej dacie zapisu
+        system_clock::time_point legacyEnd = system_clock::now();
+        if (!dates.empty()) ParseGiosDate(dates.back(), legacyEnd);
+        auto readSeries = [&](const json& values, const json* times, SensorSeries& out) {
+            auto v = values.get<std::vector<double>>();
+            std::vector<int64_t> t;
+            if (times && times->is_array()) t = times->get<std::vector<int64_t>>();
+            out.Reserve(v.size());
+            const int64_t end = static_cast<int64_t>(system_clock::to_time_t(legacyEnd));
+            for (size_t i = 0; i < v.size(); ++i) {
+                int64_t ts = i < t.size() ? t[i] : end - static_cast<int64_t>(v.size() - 1 - i) * 3600;
+                out.Append(ts, v[i]);
+            }
+            };
+        readSeries(station_data["history"], station_data.contains("history_ts") ? &station_data["history_ts"] : nullptr, station.history);
+
+        if (station_data.contains("sensors")) {
+            for (const auto& [sensor_id_str, sensor_data] : station_data["sensors"].items()) {
+                int sensor_id = std::stoi(sensor_id_str);
+                readSeries(sensor_data["values"], sensor_data.contains("timestamps") ? &sensor_data["timestamps"] : nullptr,
+                    station.sensors.At(sensor_id));
+                station.sensors.SetName(sensor_id, sensor_data["name"].get<std::string>());
+            }
+        }
+        return true;
+    }
+    catch (...) {
+        return false;
+    }
+}
+
+///KONWERSJA Z U8 NA 16
+std::wstring Utf8ToUtf16(const std::string& utf8)
+{
+    if (utf8.empty()) return {};
+    int wsz = MultiByteToWideChar(
+        CP_UTF8, 0,
+        utf8.data(), (int)utf8.size(),
+        nullptr, 0
+    );
+    std::wstring wstr;
+    wstr.resize(wsz);
+    MultiByteToWideChar(
+        CP_UTF8, 0,
+        utf8.data(), (int)utf8.size(),
+        &wstr[0], wsz
+    );
+    return wstr;
+}
+
+
+/// Serializuje dane stacji do formatu JSON (tylko dane już obecne w pamięci)
+std::string SerializeDB(const std::vector<std::string>& dates, const Station& station) {
+    json j;
+    json station_data;
+    station_data["id"] = station.id;
+    station_data["stationName"] = station.name;
+    station_data["city"] = station.city;
+    station_data["region"] = station.region;
+    station_data["lat"] = station.lat;
+    station_data["lon"] = station.lon;
+    SeriesView history = station.history.View();
+    station_data["history"] = std::vector<double>(history.values, history.values + history.size);
+    station_data["history_ts"] = std::vector<int64_t>(history.ts, history.ts + history.size);
+
+    json sensors_data;
+    for (size_t i = 0; i < station.sensors.Size(); ++i) {
+        json sensor_info;
+        sensor_info["name"] = station.sensors.NameAt(i);
+        SeriesView v = station.sensors.SeriesAt(i).View();
+        sensor_info["values"] = std::vector<double>(v.values, v.values + v.size);
+        sensor_info["timestamps"] = std::vector<int64_t>(v.ts, v.ts + v.size);
+        sensors_data[std::to_string(station.sensors.IdAt(i))] = sensor_info;
+    }
+    station_data["sensors"] = sensors_data;
+    j["station"] = station_data;
+    j["dates"] = dates;
+    return j.dump(2);
+}
+
+//******************************************************************************************
+// Binarny format zapisu (.aqb)
+//******************************************************************************************
+
+/// Nagłówek pliku .aqb. Przesunięcia liczone są od początku pliku; napisy to przesunięcia
+/// w tablicy napisów (zakończone zerem). Dane liczbowe zapisywane są w natywnym układzie little-endian.
+struct AqbHeader {
+    char magic[4];                  // "AQIB"
+    uint32_t version;
+    int32_t stationId;
+    uint32_t nameStr, cityStr, regionStr;
+    double lat, lon;
+    uint32_t seriesCount;           // historia stacji + sensory
+    uint32_t dateCount;
+    uint64_t seriesTableOffset;     // AqbSeriesEntry[seriesCount]; wpis 0 to historia stacji
+    uint64_t dateTableOffset;       // uint32_t[dateCount] – przesunięcia napisów dat
+    uint64_t stringTableOffset, stringTableSize;
+    uint64_t fileSize;
+};
+
+/// Wpis tablicy serii: kolumny czasów (int64, sekundy UTC) i wartości (double) o stałej szerokości
+struct AqbSeriesEntry {
+    int32_t sensorId;
+    uint32_t nameStr;
+    uint64_t count;
+    uint64_t tsOffset;
+    uint64_t valuesOffset;
+};
+
+constexpr uint32_t AQB_VERSION = 1;
+
+/// Sprawdza rozszerzenie nazwy pliku (bez rozróżniania wielkości liter)
+bool HasExtension(const std::string& fn, const char* ext) {
+    size_t n = strlen(ext);
+    return fn.size() >= n && _stricmp(fn.c_str() + fn.size() - n, ext) == 0;
+}
+
+/// Plik zmapowany w pamięci tylko do odczytu; zamyka widok i uchwyty w destruktorze
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return;
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data) size = static_cast<size_t>(fileSize.QuadPart);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+
+    const char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+/// Serializuje dane stacji do formatu .aqb: nagłówek, tablica serii, tablica dat, tablica napisów
+/// i wyrównane do 8 bajtów kolumny czasów/wartości
+std::string SerializeDBBinary(const std::vector<std::string>& dates, const Station& station) {
+    std::string strings;
+    auto addString = [&](const std::string& str) {
+        uint32_t off = static_cast<uint32_t>(strings.size());
+        strings.append(str.c_str(), str.size() + 1);
+        return off;
+        };
+    auto align8 = [](uint64_t off) { return (off + 7) & ~uint64_t(7); };
+
+    AqbHeader h{};
+    memcpy(h.magic, "AQIB", 4);
+    h.version = AQB_VERSION;
+    h.stationId = station.id;
+    h.nameStr = addString(station.name);
+    h.cityStr = addString(station.city);
+    h.regionStr = addString(station.region);
+    h.lat = station.lat;
+    h.lon = station.lon;
+
+    std::vector<const SensorSeries*> columns{ &station.history };
+    std::vector<AqbSeriesEntry> entries(1);
+    entries[0].sensorId = 0;
+    entries[0].nameStr = addString("");
+    for (size_t i = 0; i < station.sensors.Size(); ++i) {
+        AqbSeriesEntry e{};
+        e.sensorId = station.sensors.IdAt(i);
+        e.nameStr = addString(station.sensors.NameAt(i));
+        entries.push_back(e);
+        columns.push_back(&station.sensors.SeriesAt(i));
+    }
+    std::vector<uint32_t> dateTable;
+    for (const auto& d : dates)
+        dateTable.push_back(addString(d));
+
+    h.seriesCount = static_cast<uint32_t>(entries.size());
+    h.dateCount = static_cast<uint32_t>(dateTable.size());
+    h.seriesTableOffset = sizeof(AqbHeader);
+    h.dateTableOffset = h.seriesTableOffset + entries.size() * sizeof(AqbSeriesEntry);
+    h.stringTableOffset = h.dateTableOffset + dateTable.size() * sizeof(uint32_t);
+    h.stringTableSize = strings.size();
+    uint64_t off = align8(h.stringTableOffset + h.stringTableSize);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        entries[i].count = columns[i]->Size();
+        entries[i].tsOffset = off;
+        off += entries[i].count * sizeof(int64_t);
+        entries[i].valuesOffset = off;
+        off += entries[i].count * sizeof(double);
+    }
+    h.fileSize = off;
+
+    std::string buf(static_cast<size_t>(h.fileSize), '\0');
+    memcpy(&buf[0], &h, sizeof(h));
+    memcpy(&buf[0] + h.seriesTableOffset, entries.data(), entries.size() * sizeof(AqbSeriesEntry));
+    if (!dateTable.empty())
+        memcpy(&buf[0] + h.dateTableOffset, dateTable.data(), dateTable.size() * sizeof(uint32_t));
+    memcpy(&buf[0] + h.stringTableOffset, strings.data(), strings.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].count == 0) continue;
+        memcpy(&buf[0] + entries[i].tsOffset, columns[i]->Times(), entries[i].count * sizeof(int64_t));
+        memcpy(&buf[0] + entries[i].valuesOffset, columns[i]->Values(), entries[i].count * sizeof(double));
+    }
+    return buf;
+}
+
+/// Wczytuje dane stacji z pliku .aqb przez mapowanie pamięci: kolumny kopiowane są blokowo,
+/// bez parsowania pojedynczych wartości. Zwraca false dla uszkodzonego lub nieznanego pliku.
+bool LoadDBBinary(const std::string& fn, std::vector<std::string>& dates, Station& station) {
+    MappedFile file("savefiles/" + fn);
+    const char* base = file.Data();
+    const uint64_t size = file.Size();
+    if (!base || size < sizeof(AqbHeader)) return false;
+
+    AqbHeader h;
+    memcpy(&h, base, sizeof(h));
+    if (memcmp(h.magic, "AQIB", 4) != 0 || h.version != AQB_VERSION || h.fileSize > size) return false;
+
+    auto inFile = [&](uint64_t off, uint64_t count, uint64_t elem) {
+        return off <= size && count <= (size - off) / elem;
+        };
+    if (!inFile(h.seriesTableOffset, h.seriesCount, sizeof(AqbSeriesEntry)) ||
+        !inFile(h.dateTableOffset, h.dateCount, sizeof(uint32_t)) ||
+        !inFile(h.stringTableOffset, h.stringTableSize, 1) || h.seriesCount == 0)
+        return false;
+
+    const char* strings = base + h.stringTableOffset;
+    bool ok = true;
+    auto str = [&](uint32_t off) -> std::string {
+        if (off >= h.stringTableSize || !memchr(strings + off, '\0', static_cast<size_t>(h.stringTableSize - off))) {
+            ok = false;
+            return {};
+        }
+        return std::string(strings + off);
+        };
+
+    Station loaded;
+    loaded.id = h.stationId;
+    loaded.name = str(h.nameStr);
+    loaded.city = str(h.cityStr);
+    loaded.region = str(h.regionStr);
+    loaded.lat = h.lat;
+    loaded.lon = h.lon;
+
+    for (uint32_t i = 0; i < h.seriesCount && ok; ++i) {
+        AqbSeriesEntry e;
+        memcpy(&e, base + h.seriesTableOffset + i * sizeof(AqbSeriesEntry), sizeof(e));
+        if (!inFile(e.tsOffset, e.count, sizeof(int64_t)) || !inFile(e.valuesOffset, e.count, sizeof(double)))
+            return false;
+        SensorSeries& target = i == 0 ? loaded.history : loaded.sensors.At(e.sensorId);
+        target.AssignColumns(reinterpret_cast<const int64_t*>(base + e.tsOffset),
+            reinterpret_cast<const double*>(base + e.valuesOffset), static_cast<size_t>(e.count));
+        if (i > 0) loaded.sensors.SetName(e.sensorId, str(e.nameStr));
+    }
+
+    std::vector<std::string> loadedDates;
+    for (uint32_t i = 0; i < h.dateCount && ok; ++i) {
+        uint32_t off;
+        memcpy(&off, base + h.dateTableOffset + i * sizeof(uint32_t), sizeof(off));
+        loadedDates.push_back(str(off));
+    }
+    if (!ok) return false;
+
+    station = std::move(loaded);
+    dates = std::move(loadedDates);
+    return true;
+}
+
+//******************************************************************************************
+// Zapis w tle
+//******************************************************************************************
+
+/// Zapisuje plik atomowo: najpierw plik tymczasowy, potem zamiana nazwy – przerwany zapis
+/// nie uszkadza poprzedniej wersji pliku
+/// Zapisuje data do pliku (od początku lub na końcu) i czeka, aż trafi na nośnik (FlushFileBuffers)
+bool WriteFileDurable(const std::string& path, const std::string& data, bool append) {
+    HANDLE file = CreateFileA(path.c_str(), append ? FILE_APPEND_DATA : GENERIC_WRITE, 0, nullptr,
+        append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    bool ok = true;
+    for (size_t off = 0; ok && off < data.size();) {
+        DWORD written = 0;
+        const DWORD chunk = static_cast<DWORD>(std::min<size_t>(data.size() - off, 1u << 30));
+        ok = WriteFile(file, data.data() + off, chunk, &written, nullptr) && written > 0;
+        off += written;
+    }
+    ok = ok && FlushFileBuffers(file);
+    CloseHandle(file);
+    return ok;
+}
+
+void WriteFileAtomic(const std::string& path, const std::string& data) {
+    // Unikalna nazwa pliku tymczasowego: równolegli piszący ten sam plik nie nadpisują sobie nawzajem kopii roboczej
+    static std::atomic<uint64_t> tmpCounter{ 0 };
+    const std::string tmp = path + "." + std::to_string(GetCurrentThreadId()) + "." + std::to_string(++tmpCounter) + ".tmp";
+    // Treść musi być na nośniku przed podmianą – inaczej awaria mogłaby zostawić pusty plik pod docelową nazwą
+    if (!WriteFileDurable(tmp, data, false)) {
+        DeleteFileA(tmp.c_str());
+        throw std::runtime_error("Nie można zapisać pliku: " + tmp);
+    }
+    if (!MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        DeleteFileA(tmp.c_str());
+        throw std::runtime_error("Nie można zastąpić pliku: " + path);
+    }
+}
+
+/// Zapisuje dane stacji do pliku lokalnego (JSON lub .aqb); nie korzysta z sieci
+void SaveDB(const std::string& fn, const std::vector<std::string>& dates, const Station& station, bool binary) {
+    CreateDirectoryA("savefiles", nullptr);
+    WriteFileAtomic("savefiles/" + fn, binary ? SerializeDBBinary(dates, station) : SerializeDB(dates, station));
+}
+
+/// Wywołania zwrotne zapisu w tle; wykonują się w wątku UI (przez ui_queue)
+struct SaveCallbacks {
+    std::function<void(size_t done, size_t total)> onProgress;
+    std::function<void(int stationId, int sensorId, const Series&)> onSeries;
+    /// Zapis się udał; failed to sensory, których brakującej serii nie udało się pobrać (id, błąd) –
+    /// zapisano je bez danych
+    std::function<void(const std::string& fn, const std::vector<std::pair<int, std::string>>& failed)> onDone;
+    std::function<void(const std::string& error)> onError;
+};
+
+/// Zapis w tle w dwóch etapach: równoległe pobranie brakujących serii sensorów,
+/// a następnie serializacja i atomowy zapis kopii stacji w wątku roboczym. Sensory, których serii
+/// nie udało się pobrać, trafiają do pliku bez danych i są wymienione w onDone
+void SaveDBAsync(std::string fn, std::vector<std::string> dates, Station station, bool binary, SaveCallbacks cb) {
+    TaskScheduler::Instance().Submit([fn = std::move(fn), dates = std::move(dates), station = std::move(station), binary, cb = std::move(cb)]() mutable {
+        std::vector<size_t> missing;
+        for (size_t i = 0; i < station.sensors.Size(); ++i)
+            if (station.sensors.SeriesAt(i).Empty())
+                missing.push_back(i);
+
+        const size_t total = missing.size() + 1;
+        std::atomic<size_t> done{ 0 };
+        auto progress = [&]() {
+            size_t d = ++done;
+            ui_queue.Post([cb, d, total]() { if (cb.onProgress) cb.onProgress(d, total); });
+            };
+
+        std::vector<Series> fetched(missing.size());
+        std::vector<std::string> errors(missing.size());
+        ParallelFor(missing.size(), StationFetchEngine::kMaxParallel, [&](size_t k) {
+            try {
+                fetched[k] = FetchData(station.sensors.IdAt(missing[k]));
+            }
+            catch (const std::exception& e) {
+                errors[k] = e.what();
+            }
+            progress();
+            });
+        std::vector<std::pair<int, std::string>> failed;
+        for (size_t k = 0; k < missing.size(); ++k)
+            if (!errors[k].empty())
+                failed.emplace_back(station.sensors.IdAt(missing[k]), std::move(errors[k]));
+        for (size_t k = 0; k < missing.size(); ++k) {
+            if (fetched[k].empty()) continue;
+            station.sensors.SeriesAt(missing[k]).Assign(fetched[k]);
+            ui_queue.Post([cb, stationId = station.id, sensorId = station.sensors.IdAt(missing[k]), series = std::move(fetched[k])]() {
+                if (cb.onSeries) cb.onSeries(stationId, sensorId, series);
+                });
+        }
+
+        try {
+            SaveDB(fn, dates, station, binary);
+            progress();
+            ui_queue.Post([cb, fn, failed = std::move(failed)]() { if (cb.onDone) cb.onDone(fn, failed); });
+        }
+        catch (const std::exception& e) {
+            std::string what = e.what();
+            ui_queue.Post([cb, what]() { if (cb.onError) cb.onError(what); });
+        }
+    }, TaskPriority::Normal);
+}
+
+//******************************************************************************************
+// Dziennik przyrostowy serii (journal/)
+//******************************************************************************************
+
+/// Tablica CRC-32 (IEEE 802.3) wyznaczana w czasie kompilacji
+struct Crc32Table {
+    uint32_t t[256];
+    constexpr Crc32Table() : t() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+    }
+};
+constexpr Crc32Table kCrc32Table;
+
+uint32_t Crc32(const void* data, size_t n) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < n; ++i)
+        c = kCrc32Table.t[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+/// Dziennik serii pomiarowych: dla każdej pary (stacja, sensor) ciąg segmentów
+/// journal/<stacja>/<sensor>.<nr>.seg z rekordami stałej długości (czas, wartość, CRC).
+/// Dopisywane są tylko próbki, których czasu dziennik jeszcze nie zawiera, więc ilość zapisów rośnie
+/// z liczbą nowych danych, a nie z długością historii. Próbki spóźnione (starsze od ostatnio zapisanej)
+/// też trafiają do aktywnego segmentu; porządek czasu przywraca odczyt i scalanie (SensorSeries::Append).
+/// Zapis jest utrwalany na nośniku przed aktualizacją stanu strumienia. Sensor 0 to historia stacji.
+/// Po awarii segment jest obcinany do ostatniego poprawnego rekordu. Zamknięte segmenty są w tle
+/// scalane warstwowo: kMergeWidth sąsiednich segmentów tej samej warstwy rozmiaru daje jeden segment
+/// warstwy wyżej, więc każdy rekord jest przepisywany O(log n) razy.
+/// Operacje plikowe (zapis, odtwarzanie stanu, naprawa) wykonywane są kolejno w puli wątków;
+/// metody publiczne jedynie je zlecają, z wyjątkiem Load i Stations.
+class SeriesJournal {
+public:
+    static constexpr size_t kRecordSize = 20;             // int64 czas, double wartość, uint32 CRC
+    static constexpr uint64_t kSegmentBytes = 64 * 1024;
+    static constexpr size_t kMergeWidth = 4;              // liczba segmentów jednej warstwy uruchamiająca scalanie
+
+    static SeriesJournal& Instance() {
+        static SeriesJournal journal;
+        return journal;
+    }
+
+    /// Zapisuje metadane stacji (nazwa, położenie, nazwy sensorów); mały plik zastępowany atomowo
+    void WriteMeta(const Station& station) {
+        json j;
+        j["id"] = station.id;
+        j["stationName"] = station.name;
+        j["city"] = station.city;
+        j["region"] = station.region;
+        j["lat"] = station.lat;
+        j["lon"] = station.lon;
+        json names = json::object();
+        for (size_t i = 0; i < station.sensors.Size(); ++i)
+            names[std::to_string(station.sensors.IdAt(i))] = station.sensors.NameAt(i);
+        j["sensors"] = names;
+        Post([this, stationId = station.id, text = j.dump()]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            CreateDirectoryA("journal", nullptr);
+            CreateDirectoryA(Dir(stationId).c_str(), nullptr);
+            try {
+                WriteFileAtomic(Dir(stationId) + "/station.json", text);
+            }
+            catch (const std::exception&) {
+            }
+            });
+    }
+
+    /// Zleca dopisanie do aktywnego segmentu próbek serii, których dziennik jeszcze nie zawiera.
+    /// Kolumny są kopiowane, więc widok nie musi przeżyć wywołania.
+    void Append(int stationId, int sensorId, SeriesView v) {
+        if (v.size == 0) return;
+        Post([this, stationId, sensorId, ts = std::vector<int64_t>(v.ts, v.ts + v.size),
+            values = std::vector<double>(v.values, v.values + v.size)]() {
+            AppendNow(stationId, sensorId, { ts.data(), values.data(), ts.size() });
+            });
+    }
+
+    /// Czeka, aż wszystkie zlecone zapisy trafią na dysk (przed zatrzymaniem puli wątków)
+    void Flush() {
+        std::unique_lock<std::mutex> lock(jobsMutex);
+        jobsDone.wait(lock, [this]() { return !draining; });
+    }
+
+    /// Odtwarza stację z dziennika; daty budowane są ze znaczników czasu historii
+    bool Load(int stationId, Station& station, std::vector<std::string>& dates) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ifstream in(Dir(stationId) + "/station.json");
+        if (!in) return false;
+        auto j = json::parse(in, nullptr, false);
+        if (j.is_discarded() || !j.is_object()) return false;
+
+        Station loaded;
+        loaded.id = stationId;
+        loaded.name = j.value("stationName", "");
+        loaded.city = j.value("city", "");
+        loaded.region = j.value("region", "");
+        loaded.lat = j.value("lat", 0.0);
+        loaded.lon = j.value("lon", 0.0);
+        if (j.contains("sensors") && j["sensors"].is_object()) {
+            for (auto& [id, name] : j["sensors"].items())
+                if (name.is_string()) loaded.sensors.SetName(std::stoi(id), name.get<std::string>());
+        }
+
+        std::vector<int> sensorIds;
+        ForEachSegment(stationId, [&](int sensorId, uint32_t) { sensorIds.push_back(sensorId); });
+        std::sort(sensorIds.begin(), sensorIds.end());
+        sensorIds.erase(std::unique(sensorIds.begin(), sensorIds.end()), sensorIds.end());
+        for (int sensorId : sensorIds) {
+            Stream& s = Open(stationId, sensorId);
+            SensorSeries& target = sensorId == 0 ? loaded.history : loaded.sensors.At(sensorId);
+            auto add = [&](int64_t t, double value) { target.Append(t, value); };
+            for (const Segment& seg : s.sealed)
+                ReadSegment(SegmentPath(stationId, sensorId, seg.seq), add, false);
+            ReadSegment(SegmentPath(stationId, sensorId, s.activeSeq), add, false);
+        }
+
+        std::vector<std::string> loadedDates;
+        for (size_t i = 0; i < loaded.history.Size(); ++i) {
+            time_t t = static_cast<time_t>(loaded.history.Times()[i]);
+            std::tm tm;
+            localtime_s(&tm, &t);
+            char buf[64];
+            strftime(buf, sizeof(buf), "%Y-%m-%d %H", &tm);
+            loadedDates.push_back(buf);
+        }
+        station = std::move(loaded);
+        dates = std::move(loadedDates);
+        return true;
+    }
+
+    /// Nazwy sensorów ze wszystkich metadanych stacji w dzienniku (id sensora -> nazwa parametru)
+    std::unordered_map<int, std::string> SensorNames() const {
+        std::unordered_map<int, std::string> names;
+        for (int stationId : Stations()) {
+            std::ifstream in(Dir(stationId) + "/station.json");
+            if (!in) continue;
+            auto j = json::parse(in, nullptr, false);
+            if (j.is_discarded() || !j.is_object() || !j.contains("sensors") || !j["sensors"].is_object()) continue;
+            for (auto& [id, name] : j["sensors"].items()) {
+                char* end;
+                long sensorId = strtol(id.c_str(), &end, 10);
+                if (name.is_string() && end != id.c_str() && *end == '\0')
+                    names[static_cast<int>(sensorId)] = name.get<std::string>();
+            }
+        }
+        return names;
+    }
+
+    /// Zwraca identyfikatory stacji, dla których istnieje dziennik
+    std::vector<int> Stations() const {
+        std::vector<int> ids;
+        WIN32_FIND_DATAA findData;
+        HANDLE hFind = FindFirstFileA("journal\\*", &findData);
+        if (hFind == INVALID_HANDLE_VALUE) return ids;
+        do {
+            char* end;
+            long id = strtol(findData.cFileName, &end, 10);
+            if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && end != findData.cFileName && *end == '\0')
+                ids.push_back(static_cast<int>(id));
+        } while (FindNextFileA(hFind, &findData));
+        FindClose(hFind);
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+private:
+    /// Zamknięty segment i jego rozmiar w bajtach (wyznacza warstwę przy scalaniu)
+    struct Segment {
+        uint32_t seq;
+        uint64_t bytes;
+    };
+
+    /// Stan strumienia (stacja, sensor): zamknięte segmenty, aktywny segment i zapisane czasy
+    struct Stream {
+        std::vector<Segment> sealed;
+        uint32_t activeSeq = 1;
+        uint64_t activeBytes = 0;
+        std::vector<int64_t> times;   // posortowane czasy wszystkich zapisanych próbek
+        bool compacting = false;
+
+        int64_t LastTs() const { return times.empty() ? INT64_MIN : times.back(); }
+    };
+
+    static std::string Dir(int stationId) { return "journal/" + std::to_string(stationId); }
+
+    /// Warstwa segmentu: 0 poniżej kSegmentBytes * kMergeWidth, każda kolejna kMergeWidth razy większa
+    static int Tier(uint64_t bytes) {
+        int tier = 0;
+        for (uint64_t cap = kSegmentBytes * kMergeWidth; bytes >= cap; cap *= kMergeWidth)
+            ++tier;
+        return tier;
+    }
+
+    /// Dodaje zadanie do kolejki dziennika; kolejka jest opróżniana przez jedno zadanie puli naraz,
+    /// co zachowuje kolejność zapisów i nie blokuje wątku UI operacjami plikowymi
+    void Post(std::function<void()> job) {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.push_back(std::move(job));
+        if (draining) return;
+        draining = true;
+        TaskScheduler::Instance().Submit([this]() { Drain(); }, TaskPriority::Low);
+    }
+
+    void Drain() {
+        std::unique_lock<std::mutex> lock(jobsMutex);
+        while (!jobs.empty()) {
+            auto job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+        draining = false;
+        jobsDone.notify_all();
+    }
+
+    /// Dopisuje do aktywnego segmentu próbki serii, których czasów dziennik nie zawiera (w kolejce dziennika).
+    /// Próbki nowsze od ostatniej zapisanej wyszukiwane są binarnie, spóźnione – w zbiorze zapisanych czasów.
+    void AppendNow(int stationId, int sensorId, SeriesView v) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stream& s = Open(stationId, sensorId);
+        const size_t from = std::upper_bound(v.ts, v.ts + v.size, s.LastTs()) - v.ts;
+        std::vector<size_t> late;
+        for (size_t i = 0; i < from; ++i)
+            if (!std::binary_search(s.times.begin(), s.times.end(), v.ts[i]))
+                late.push_back(i);
+        if (from == v.size && late.empty()) return;
+
+        std::string buf;
+        buf.reserve((v.size - from + late.size()) * kRecordSize);
+        for (size_t i : late)
+            EncodeRecord(buf, v.ts[i], v.values[i]);
+        for (size_t i = from; i < v.size; ++i)
+            EncodeRecord(buf, v.ts[i], v.values[i]);
+        // Stan strumienia zmienia się dopiero po utrwaleniu rekordów
+        if (!WriteFileDurable(SegmentPath(stationId, sensorId, s.activeSeq), buf, true))
+            return;
+        for (size_t i : late)
+            s.times.insert(std::lower_bound(s.times.begin(), s.times.end(), v.ts[i]), v.ts[i]);
+        s.times.insert(s.times.end(), v.ts + from, v.ts + v.size);
+        s.activeBytes += buf.size();
+        if (s.activeBytes >= kSegmentBytes) {
+            s.sealed.push_back({ s.activeSeq++, s.activeBytes });
+            s.activeBytes = 0;
+        }
+        MaybeCompact(stationId, sensorId, s);
+    }
+
+    static std::string SegmentPath(int stationId, int sensorId, uint32_t seq) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "/%d.%08u.seg", sensorId, seq);
+        return Dir(stationId) + buf;
+    }
+
+    static void EncodeRecord(std::string& out, int64_t t, double value) {
+        char rec[kRecordSize];
+        memcpy(rec, &t, 8);
+        memcpy(rec + 8, &value, 8);
+        uint32_t crc = Crc32(rec, 16);
+        memcpy(rec + 16, &crc, 4);
+        out.append(rec, kRecordSize);
     }
-    return DefWindowProc(h, m, w, l);
-}
 
-//******************************************************************************************
-// REST Fetch Routines
-//******************************************************************************************
+    /// Wywołuje fn(sensorId, nr) dla każdego pliku segmentu stacji
+    template <typename Fn>
+    static void ForEachSegment(int stationId, Fn fn) {
+        WIN32_FIND_DATAA findData;
+        HANDLE hFind = FindFirstFileA(("journal\\" + std::to_string(stationId) + "\\*.seg").c_str(), &findData);
+        if (hFind == INVALID_HANDLE_VALUE) return;
+        do {
+            char* end;
+            long sensorId = strtol(findData.cFileName, &end, 10);
+            if (end == findData.cFileName || *end != '.') continue;
+            const char* seqStart = end + 1;
+            unsigned long seq = strtoul(seqStart, &end, 10);
+            if (end != seqStart && strcmp(end, ".seg") == 0)
+                fn(static_cast<int>(sensorId), static_cast<uint32_t>(seq));
+        } while (FindNextFileA(hFind, &findData));
+        FindClose(hFind);
+    }
 
-/// Pobiera wszystkie stacje AQI z API
-std::vector<Station> FetchAll() {
-    std::ofstream error_log("error_log.txt", std::ios::app); // Plik do logowania błędów
+    /// Przekazuje poprawne rekordy segmentu do fn i zwraca ich łączny rozmiar w bajtach.
+    /// Czyta do pierwszego rekordu z błędną sumą CRC lub niepełnego; z repair=true obcina tam plik.
+    template <typename Fn>
+    static uint64_t ReadSegment(const std::string& path, Fn fn, bool repair) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return 0;
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        size_t valid = 0;
+        for (; valid + kRecordSize <= content.size(); valid += kRecordSize) {
+            const char* rec = content.data() + valid;
+            uint32_t crc;
+            memcpy(&crc, rec + 16, 4);
+            if (crc != Crc32(rec, 16)) break;
+            int64_t t;
+            double value;
+            memcpy(&t, rec, 8);
+            memcpy(&value, rec + 8, 8);
+            fn(t, value);
+        }
+        if (repair && valid < content.size()) {
+            try {
+                WriteFileAtomic(path, content.substr(0, valid));
+            }
+            catch (const std::exception&) {
+            }
+        }
+        return valid;
+    }
 
-    try {
-        // Pobierz odpowiedź z API
-        std::string resp = SafeGet(L"api.gios.gov.pl", L"/pjp-api/rest/station/findAll");
+    /// Zwraca strumień, przy pierwszym użyciu odtwarzając jego stan z dysku (wywoływane pod blokadą)
+    Stream& Open(int stationId, int sensorId) {
+        const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(stationId)) << 32) | static_cast<uint32_t>(sensorId);
+        auto it = streams.find(key);
+        if (it != streams.end()) return it->second;
 
-        // Parsuj JSON
-        auto arr = json::parse(resp, nullptr, false);
-        if (arr.is_discarded()) {
-            error_log << "Nieprawidłowa odpowiedź JSON\n";
-            throw std::runtime_error("Nieprawidłowa odpowiedź JSON");
+        Stream& s = streams[key];
+        CreateDirectoryA("journal", nullptr);
+        CreateDirectoryA(Dir(stationId).c_str(), nullptr);
+        std::vector<uint32_t> seqs;
+        ForEachSegment(stationId, [&](int id, uint32_t seq) { if (id == sensorId) seqs.push_back(seq); });
+        std::sort(seqs.begin(), seqs.end());
+        for (uint32_t seq : seqs) {
+            uint64_t bytes = ReadSegment(SegmentPath(stationId, sensorId, seq),
+                [&](int64_t t, double) { s.times.push_back(t); }, true);
+            if (seq == seqs.back()) {
+                s.activeSeq = seq;
+                s.activeBytes = bytes;
+            }
+            else {
+                s.sealed.push_back({ seq, bytes });
+            }
+        }
+        std::sort(s.times.begin(), s.times.end());
+        s.times.erase(std::unique(s.times.begin(), s.times.end()), s.times.end());
+        if (s.activeBytes >= kSegmentBytes) {
+            s.sealed.push_back({ s.activeSeq++, s.activeBytes });
+            s.activeBytes = 0;
         }
+        return s;
+    }
 
-        // Sprawdź, czy otrzymany obiekt to tablica
-        if (!arr.is_array()) {
-            error_log << "Oczekiwano tablicy stacji\n";
-            throw std::runtime_error("Oczekiwano tablicy stacji");
+    /// Szuka od najnowszych kMergeWidth sąsiednich zamkniętych segmentów tej samej warstwy
+    /// i zleca ich scalenie (wywoływane pod blokadą)
+    void MaybeCompact(int stationId, int sensorId, Stream& s) {
+        if (s.compacting || s.sealed.size() < kMergeWidth) return;
+        size_t runEnd = s.sealed.size();
+        for (size_t i = s.sealed.size(); i-- > 0;) {
+            if (Tier(s.sealed[i].bytes) != Tier(s.sealed[runEnd - 1].bytes))
+                runEnd = i + 1;
+            if (runEnd - i == kMergeWidth) {
+                std::vector<uint32_t> seqs;
+                for (size_t k = i; k < runEnd; ++k)
+                    seqs.push_back(s.sealed[k].seq);
+                StartCompaction(stationId, sensorId, s, std::move(seqs));
+                return;
+            }
         }
+    }
 
-        std::vector<Station> out;
-        for (auto& e : arr) {
+    /// Scala w tle podane sąsiednie zamknięte segmenty w jeden (pod numerem pierwszego) i usuwa pozostałe.
+    /// Scalony segment jest posortowany po czasie, także gdy źródła zawierały próbki spóźnione.
+    void StartCompaction(int stationId, int sensorId, Stream& s, std::vector<uint32_t> seqs) {
+        s.compacting = true;
+        TaskScheduler::Instance().Submit([this, stationId, sensorId, seqs]() {
+            SensorSeries merged;
+            for (uint32_t seq : seqs)
+                ReadSegment(SegmentPath(stationId, sensorId, seq), [&](int64_t t, double value) { merged.Append(t, value); }, false);
+            std::string buf;
+            buf.reserve(merged.Size() * kRecordSize);
+            for (size_t i = 0; i < merged.Size(); ++i)
+                EncodeRecord(buf, merged.Times()[i], merged.Values()[i]);
+
+            const std::string target = SegmentPath(stationId, sensorId, seqs.front());
+            bool written = true;
             try {
-                Station s;
-                s.id = e["id"].get<int>();
-                s.name = e["stationName"].get<std::string>();
+                WriteFileAtomic(target + ".compact", buf);
+            }
+            catch (const std::exception&) {
+                written = false;
+            }
 
-                if (e.contains("city") && e["city"].is_object()) {
-                    auto& city = e["city"];
-                    s.city = city["name"].get<std::string>();
+            std::lock_guard<std::mutex> lock(mutex);
+            Stream& st = Open(stationId, sensorId);
+            st.compacting = false;
+            if (!written || !MoveFileExA((target + ".compact").c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING))
+                return;
+            for (size_t i = 1; i < seqs.size(); ++i)
+                DeleteFileA(SegmentPath(stationId, sensorId, seqs[i]).c_str());
+            auto first = std::find_if(st.sealed.begin(), st.sealed.end(), [&](const Segment& seg) { return seg.seq == seqs.front(); });
+            first->bytes = buf.size();
+            st.sealed.erase(first + 1, first + seqs.size());
+            MaybeCompact(stationId, sensorId, st);   // scalony segment może domknąć warstwę wyżej
+            }, TaskPriority::Low);
+    }
 
-                    if (city.contains("commune") && city["commune"].is_object()) {
-                        auto& commune = city["commune"];
-                        s.region = commune["provinceName"].get<std::string>();
-                    }
-                }
+    std::mutex mutex;
+    std::map<uint64_t, Stream> streams;
 
-                auto parseCoordinate = [](const json& j, const std::string& field) -> double {
-                    if (!j.contains(field)) return 0.0;
-                    if (j[field].is_number()) return j[field].get<double>();
-                    if (j[field].is_string()) {
-                        try { return std::stod(j[field].get<std::string>()); }
-                        catch (...) { return 0.0; }
-                    }
-                    return 0.0;
-                    };
+    std::mutex jobsMutex;                  // kolejka zadań plikowych
+    std::condition_variable jobsDone;
+    std::deque<std::function<void()>> jobs;
+    bool draining = false;                 // zadanie opróżniające kolejkę jest zlecone lub trwa
+};
+
+//******************************************************************************************
+// Archiwum dziennych migawek stacji (stations_db.json / of_stations_db.json)
+//******************************************************************************************
 
-                s.lat = parseCoordinate(e, "gegrLat");
-                s.lon = parseCoordinate(e, "gegrLon");
+/// Stacja w jednym dniu migawki: indeks zbiorczy i wartości sensorów
+struct ArchiveRecord {
+    std::string date;
+    int stationId = 0;
+    std::string name, city, region;
+    double index = 0;
+    std::vector<std::pair<int, double>> sensors;
+};
 
-                out.push_back(s);
-            }
-            catch (const std::exception& e) {
-                error_log << "Pominięto stację: " << e.what() << "\n";
-                continue;
+/// Handler SAX pliku migawek {data: [{id, stationName, city, region, index, sensors: {id: wartość}}, ...]}.
+/// Data skracana jest do dnia (RRRR-MM-DD); rekord bez id jest pomijany.
+class SnapshotArchiveSax : public JsonPathSax {
+public:
+    std::vector<ArchiveRecord> out;
+
+protected:
+    bool Enter(bool isObject) override {
+        if (Depth() == 0 && !isObject) return Fail("Oczekiwano obiektu migawek");
+        if (Depth() == 2 && isObject) {
+            cur = ArchiveRecord();
+            cur.date = path[0].substr(0, 10);
+            hasId = false;
+        }
+        return true;
+    }
+
+    bool Leave(bool isObject) override {
+        if (Depth() == 2 && isObject && hasId) out.push_back(std::move(cur));
+        return true;
+    }
+
+    bool Value(const SaxScalar& v) override {
+        if (Depth() == 3) {
+            const auto& k = Key();
+            if (k == "id" && v.kind == SaxScalar::Number) { cur.stationId = static_cast<int>(v.number); hasId = true; }
+            else if (k == "index" && v.kind == SaxScalar::Number) cur.index = v.number;
+            else if (v.kind == SaxScalar::String) {
+                if (k == "stationName") cur.name = *v.text;
+                else if (k == "city") cur.city = *v.text;
+                else if (k == "region") cur.region = *v.text;
             }
         }
-        if (out.empty()) {
-            error_log << "Nie znaleziono poprawnych stacji\n";
-            throw std::runtime_error("Nie znaleziono żadnych poprawnych stacji");
+        else if (Depth() == 4 && path[2] == "sensors" && v.kind == SaxScalar::Number) {
+            try { cur.sensors.emplace_back(std::stoi(Key()), v.number); }
+            catch (...) {}
         }
-        return out;
-    }
-    catch (const std::exception& e) {
-        error_log << "Błąd FetchAll: " << e.what() << "\n";
-        throw NetworkException("Nie można pobrać stacji: " + std::string(e.what()));
+        return true;
     }
-}
 
-/// Pobiera stacje według nazwy miasta
-std::vector<Station> FetchByCity(const std::string& city) {
-    auto all = FetchAll();
-    std::vector<Station> filt;
-    filt.reserve(all.size());
-    for (const auto& s : all)
-        if (_stricmp(s.city.c_str(), city.c_str()) == 0)
-            filt.push_back(s);
-    return filt;
-}
+private:
+    ArchiveRecord cur;
+    bool hasId = false;
+};
 
-/// Pobiera stacje w obrębie określonego promienia od danego adresu
-std::vector<Station> FetchByRadius(const std::string& addr, int km) {
-    auto center = Geocode(addr);
-    auto all = FetchAll();
-    std::vector<Station> filt;
-    filt.reserve(all.size());
-    for (const auto& s : all)
-        if (Haversine(center.first, center.second, s.lat, s.lon) <= km)
-            filt.push_back(s);
-    return filt;
-}
+/// Dzienny punkt indeksu regionu: średnia, minimum i maksimum po stacjach regionu
+struct RegionIndexPoint {
+    std::string date;
+    double mean = 0, min = 0, max = 0;
+    int stations = 0;
+};
 
-/// Pobiera sensory danej stacji
-std::vector<Sensor> FetchSensors(int sid) {
-    std::string path = "/pjp-api/rest/station/sensors/" + std::to_string(sid);
-    std::wstring wpath(path.begin(), path.end());
-    std::string resp;
-    try {
-        resp = SafeGet(L"api.gios.gov.pl", wpath);
-        std::ofstream("last_sensors.json") << resp; // DEBUG
-    }
-    catch (const NetworkException& e) {
-        throw NetworkException("Błąd połączenia: " + std::string(e.what()));
-    }
-    try {
-        auto arr = json::parse(resp);
-        if (!arr.is_array()) {
-            throw NetworkException("Oczekiwano tablicy w odpowiedzi");
+/// Pozycja rankingu stacji w danym dniu
+struct ArchiveRank {
+    int stationId = 0;
+    std::string name, city, region;
+    double index = 0;
+};
+
+/// Archiwum migawek w układzie kolumnowym. Wiersze (dzień, stacja) posortowane są po dniu i id stacji;
+/// wartości sensorów leżą w ciągłych tablicach indeksowanych zakresem wiersza (CSR).
+/// Indeksy pomocnicze – początek dnia, ranking dnia malejąco po indeksie i wiersze regionu
+/// w kolejności dat – pozwalają odpowiadać na zapytania bez przeglądania całego archiwum.
+class SnapshotArchive {
+public:
+    static constexpr const char* kUnknownParameter = "nieznany parametr";
+
+    /// Buduje archiwum z rekordów; późniejszy rekord tej samej pary (dzień, stacja) zastępuje wcześniejszy.
+    /// sensorParams przypisuje sensorom nazwy parametrów (migawki zawierają tylko id sensorów);
+    /// sensory bez nazwy trafiają do wspólnej grupy kUnknownParameter.
+    SnapshotArchive(std::vector<ArchiveRecord> records, const std::unordered_map<int, std::string>& sensorParams = {}) {
+        for (const auto& r : records) {
+            dates.push_back(r.date);
+            regions.push_back(r.region);
         }
-        std::vector<Sensor> out;
-        for (const auto& e : arr) {
-            Sensor s;
-            if (!e.contains("id") || !e["id"].is_number()) {
-                continue;
-            }
-            s.id = e["id"].get<int>();
-            if (e.contains("param") && e["param"].is_object()) {
-                const auto& param = e["param"];
-                if (param.contains("paramName") && param["paramName"].is_string()) {
-                    s.name = param["paramName"].get<std::string>();
-                }
-                else {
-                    s.name = "Nieznany sensor";
+        SortUnique(dates);
+        SortUnique(regions);
+
+        // Słownik stacji (po id); opis z ostatniego rekordu
+        std::vector<size_t> order(records.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return records[a].stationId < records[b].stationId; });
+        for (size_t i : order) {
+            const auto& r = records[i];
+            if (stationInfo.empty() || stationInfo.back().id != r.stationId)
+                stationInfo.push_back({ r.stationId });
+            auto& info = stationInfo.back();
+            info.name = r.name;
+            info.city = r.city;
+            info.region = Lookup(regions, r.region);
+        }
+
+        // Wiersze w kolejności (dzień, stacja); z duplikatów zostaje ostatni
+        std::vector<std::pair<uint32_t, uint32_t>> keys(records.size());
+        for (size_t i = 0; i < records.size(); ++i)
+            keys[i] = { Lookup(dates, records[i].date), StationSlot(records[i].stationId) };
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+        dateRowBegin.assign(dates.size() + 1, 0);
+        rowSensorBegin.push_back(0);
+        for (size_t k = 0; k < order.size(); ++k) {
+            size_t i = order[k];
+            if (k + 1 < order.size() && keys[order[k + 1]] == keys[i]) continue;
+            auto& r = records[i];
+            rowDate.push_back(keys[i].first);
+            rowStation.push_back(keys[i].second);
+            rowIndex.push_back(r.index);
+            std::sort(r.sensors.begin(), r.sensors.end());
+            for (const auto& [id, value] : r.sensors) {
+                if (sensorIds.size() > rowSensorBegin.back() && sensorIds.back() == id) {
+                    sensorValues.back() = value;
+                    continue;
                 }
+                sensorIds.push_back(id);
+                sensorValues.push_back(value);
             }
-            else {
-                s.name = "Brak danych";
-            }
-            out.push_back(s);
+            rowSensorBegin.push_back(static_cast<uint32_t>(sensorIds.size()));
+            ++dateRowBegin[keys[i].first + 1];
         }
-        if (out.empty()) {
-            throw NetworkException("Brak dostępnych sensorów");
+        for (size_t d = 0; d < dates.size(); ++d)
+            dateRowBegin[d + 1] += dateRowBegin[d];
+
+        rankByIndex.resize(rowDate.size());
+        std::iota(rankByIndex.begin(), rankByIndex.end(), 0);
+        for (size_t d = 0; d < dates.size(); ++d) {
+            std::sort(rankByIndex.begin() + dateRowBegin[d], rankByIndex.begin() + dateRowBegin[d + 1],
+                [&](uint32_t a, uint32_t b) { return rowIndex[a] > rowIndex[b]; });
         }
-        return out;
-    }
-    catch (const json::exception& e) {
-        throw NetworkException("Błąd parsowania JSON: " + std::string(e.what()));
-    }
-}
 
-/// Pobiera dane historyczne dla danego sensora
-json FetchData(int sensorId) {
-    std::string path = "/pjp-api/rest/data/getData/" + std::to_string(sensorId);
-    std::wstring wpath(path.begin(), path.end());
-    try {
-        std::string raw_response = SafeGet(L"api.gios.gov.pl", wpath);
-        std::ofstream("last_sensor_data.json") << raw_response; // DEBUG
-        auto j = json::parse(raw_response);
-        if (!j.contains("key") || !j["key"].is_string()) {
-            throw NetworkException("Brak lub nieprawidłowy klucz 'key' w odpowiedzi");
+        regionRows.resize(regions.size());
+        for (uint32_t row = 0; row < rowDate.size(); ++row)
+            regionRows[stationInfo[rowStation[row]].region].push_back(row);
+
+        // Parametr każdego pomiaru sensora
+        auto paramName = [&](int32_t id) -> const std::string& {
+            static const std::string unknown = kUnknownParameter;
+            auto it = sensorParams.find(id);
+            return it != sensorParams.end() ? it->second : unknown;
+        };
+        for (int32_t id : sensorIds)
+            parameters.push_back(paramName(id));
+        SortUnique(parameters);
+        std::vector<uint32_t> valueParam(sensorIds.size());
+        for (size_t i = 0; i < sensorIds.size(); ++i)
+            valueParam[i] = Lookup(parameters, paramName(sensorIds[i]));
+
+        // Dzienne szkicy stężeń (województwo, parametr); wiersze są w kolejności dni, więc dni każdej pary rosną
+        concentration.resize(regions.size() * parameters.size());
+        for (uint32_t row = 0; row < rowDate.size(); ++row) {
+            const uint32_t region = stationInfo[rowStation[row]].region;
+            for (uint32_t i = rowSensorBegin[row]; i < rowSensorBegin[row + 1]; ++i) {
+                auto& c = concentration[region * parameters.size() + valueParam[i]];
+                if (c.days.empty() || c.days.back() != rowDate[row]) {
+                    c.days.push_back(rowDate[row]);
+                    c.daily.emplace_back();
+                }
+                c.daily.back().Push(sensorValues[i]);
+            }
         }
-        if (!j.contains("values") || !j["values"].is_array()) {
-            throw NetworkException("Brak lub nieprawidłowy klucz 'values' w odpowiedzi");
+        // Archiwum jest współdzielone między wątkami – po zbudowaniu tylko odczyty skompresowanych szkiców
+        for (auto& c : concentration) {
+            for (auto& sketch : c.daily) {
+                sketch.Compress();
+                c.all.Merge(sketch);
+            }
         }
-        for (const auto& value : j["values"]) {
-            if (!value.contains("date") || !value["date"].is_string()) {
-                throw NetworkException("Brak daty w pomiarze");
+    }
+
+    /// Wczytuje pliki migawek (brakujące lub uszkodzone pomija); kolejne pliki nadpisują wcześniejsze
+    static std::shared_ptr<const SnapshotArchive> FromFiles(const std::vector<std::string>& paths,
+        const std::unordered_map<int, std::string>& sensorParams = {}) {
+        std::vector<ArchiveRecord> records;
+        for (const auto& path : paths) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) continue;
+            std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            SnapshotArchiveSax sax;
+            try {
+                sax.Parse(text);
             }
-            if (!value.contains("value")) {
-                throw NetworkException("Brak wartości w pomiarze");
+            catch (const std::exception&) {
+                continue;
             }
-            if (!value["value"].is_number() && !value["value"].is_null()) {
-                throw NetworkException("Nieprawidłowy typ wartości w pomiarze");
+            records.insert(records.end(), std::make_move_iterator(sax.out.begin()), std::make_move_iterator(sax.out.end()));
+        }
+        return std::make_shared<const SnapshotArchive>(std::move(records), sensorParams);
+    }
+
+    const std::vector<std::string>& Dates() const { return dates; }
+    const std::vector<std::string>& Regions() const { return regions; }
+    /// Parametry (nazwy sensorów) występujące w archiwum, posortowane
+    const std::vector<std::string>& Parameters() const { return parameters; }
+    size_t RowCount() const { return rowDate.size(); }
+
+    /// Indeks stacji w danym dniu; NaN gdy brak rekordu
+    double Index(const std::string& date, int stationId) const {
+        int64_t row = FindRow(date, stationId);
+        return row < 0 ? std::nan("") : rowIndex[row];
+    }
+
+    /// Wartość sensora (dzień, stacja, sensor); NaN gdy brak
+    double Value(const std::string& date, int stationId, int sensorId) const {
+        int64_t row = FindRow(date, stationId);
+        if (row < 0) return std::nan("");
+        auto first = sensorIds.begin() + rowSensorBegin[row];
+        auto last = sensorIds.begin() + rowSensorBegin[row + 1];
+        auto it = std::lower_bound(first, last, sensorId);
+        return it != last && *it == sensorId ? sensorValues[it - sensorIds.begin()] : std::nan("");
+    }
+
+    /// Dzienny indeks regionu w przedziale dat [from, to] (bez rozróżniania wielkości liter i polskich znaków)
+    std::vector<RegionIndexPoint> RegionIndex(const std::string& region, const std::string& from, const std::string& to) const {
+        std::vector<RegionIndexPoint> out;
+        const size_t r = RegionSlot(region);
+        if (r == regions.size()) return out;
+
+        const auto& rows = regionRows[r];
+        const uint32_t firstDate = static_cast<uint32_t>(std::lower_bound(dates.begin(), dates.end(), from) - dates.begin());
+        const uint32_t endDate = static_cast<uint32_t>(std::upper_bound(dates.begin(), dates.end(), to) - dates.begin());
+        auto it = std::lower_bound(rows.begin(), rows.end(), firstDate, [&](uint32_t row, uint32_t d) { return rowDate[row] < d; });
+        for (; it != rows.end() && rowDate[*it] < endDate; ++it) {
+            const double v = rowIndex[*it];
+            if (out.empty() || out.back().date != dates[rowDate[*it]]) {
+                out.push_back({ dates[rowDate[*it]], 0.0, v, v, 0 });
             }
+            auto& p = out.back();
+            p.mean += v;
+            p.min = std::min(p.min, v);
+            p.max = std::max(p.max, v);
+            ++p.stations;
         }
-        return j;
+        for (auto& p : out)
+            p.mean /= p.stations;
+        return out;
     }
-    catch (const NetworkException&) {
-        throw;
+
+    /// Szkic kwantyli stężeń parametru w województwie w przedziale dat [from, to].
+    /// Przedział obejmujący całe archiwum zwraca szkic scalony przy budowie; węższy scala szkice dzienne.
+    QuantileSketch RegionQuantiles(const std::string& region, const std::string& parameter,
+        const std::string& from, const std::string& to) const {
+        const size_t r = RegionSlot(region);
+        auto p = std::lower_bound(parameters.begin(), parameters.end(), parameter);
+        if (r == regions.size() || p == parameters.end() || *p != parameter) return QuantileSketch();
+        const auto& c = concentration[r * parameters.size() + (p - parameters.begin())];
+        const uint32_t firstDate = static_cast<uint32_t>(std::lower_bound(dates.begin(), dates.end(), from) - dates.begin());
+        const uint32_t endDate = static_cast<uint32_t>(std::upper_bound(dates.begin(), dates.end(), to) - dates.begin());
+        if (firstDate == 0 && endDate == dates.size()) return c.all;
+
+        QuantileSketch out;
+        auto it = std::lower_bound(c.days.begin(), c.days.end(), firstDate);
+        for (; it != c.days.end() && *it < endDate; ++it)
+            out.Merge(c.daily[it - c.days.begin()]);
+        return out;
     }
-    catch (const json::exception& e) {
-        throw NetworkException("Błąd parsowania JSON: " + std::string(e.what()));
+
+    /// n stacji o najwyższym indeksie w danym dniu
+    std::vector<ArchiveRank> WorstStations(const std::string& date, size_t n) const {
+        std::vector<ArchiveRank> out;
+        auto it = std::lower_bound(dates.begin(), dates.end(), date);
+        if (it == dates.end() || *it != date) return out;
+        const size_t d = it - dates.begin();
+        const size_t count = std::min<size_t>(n, dateRowBegin[d + 1] - dateRowBegin[d]);
+        for (size_t k = 0; k < count; ++k) {
+            uint32_t row = rankByIndex[dateRowBegin[d] + k];
+            const auto& info = stationInfo[rowStation[row]];
+            out.push_back({ info.id, info.name, info.city, regions[info.region], rowIndex[row] });
+        }
+        return out;
     }
-    catch (const std::exception& e) {
-        throw NetworkException("Nieznany błąd: " + std::string(e.what()));
+
+private:
+    struct StationInfo {
+        int id = 0;
+        std::string name, city;
+        uint32_t region = 0;
+    };
+
+    /// Szkice stężeń jednej pary (województwo, parametr): tylko dni z pomiarami, rosnąco
+    struct ConcentrationSketches {
+        std::vector<uint32_t> days;
+        std::vector<QuantileSketch> daily;
+        QuantileSketch all;                         // scalenie wszystkich dni
+    };
+
+    static void SortUnique(std::vector<std::string>& v) {
+        std::sort(v.begin(), v.end());
+        v.erase(std::unique(v.begin(), v.end()), v.end());
+    }
+    static uint32_t Lookup(const std::vector<std::string>& sorted, const std::string& s) {
+        return static_cast<uint32_t>(std::lower_bound(sorted.begin(), sorted.end(), s) - sorted.begin());
+    }
+    /// Pozycja województwa (bez rozróżniania wielkości liter i polskich znaków) lub regions.size()
+    size_t RegionSlot(const std::string& region) const {
+        const std::string key = FoldKey(region);
+        size_t r = 0;
+        while (r < regions.size() && FoldKey(regions[r]) != key) ++r;
+        return r;
+    }
+    uint32_t StationSlot(int id) const {
+        return static_cast<uint32_t>(std::lower_bound(stationInfo.begin(), stationInfo.end(), id,
+            [](const StationInfo& s, int v) { return s.id < v; }) - stationInfo.begin());
     }
-}
+
+    /// Wiersz (dzień, stacja) lub -1; wyszukiwanie binarne w zakresie wierszy dnia
+    int64_t FindRow(const std::string& date, int stationId) const {
+        auto dIt = std::lower_bound(dates.begin(), dates.end(), date);
+        if (dIt == dates.end() || *dIt != date) return -1;
+        const size_t d = dIt - dates.begin();
+        const uint32_t slot = StationSlot(stationId);
+        if (slot == stationInfo.size() || stationInfo[slot].id != stationId) return -1;
+        auto first = rowStation.begin() + dateRowBegin[d];
+        auto last = rowStation.begin() + dateRowBegin[d + 1];
+        auto it = std::lower_bound(first, last, slot);
+        return it != last && *it == slot ? it - rowStation.begin() : -1;
+    }
+
+    std::vector<std::string> dates;                 // posortowane dni
+    std::vector<std::string> regions;               // posortowane województwa
+    std::vector<StationInfo> stationInfo;           // posortowane po id
+
+    std::vector<uint32_t> rowDate, rowStation;      // kolumny wierszy (dzień, stacja)
+    std::vector<double> rowIndex;
+    std::vector<uint32_t> rowSensorBegin;           // sensory wiersza r: [rowSensorBegin[r], rowSensorBegin[r + 1])
+    std::vector<int32_t> sensorIds;
+    std::vector<double> sensorValues;
+
+    std::vector<uint32_t> dateRowBegin;             // wiersze dnia d: [dateRowBegin[d], dateRowBegin[d + 1])
+    std::vector<uint32_t> rankByIndex;              // wiersze każdego dnia malejąco po indeksie
+    std::vector<std::vector<uint32_t>> regionRows;  // wiersze regionu w kolejności dat
+    std::vector<std::string> parameters;            // posortowane nazwy parametrów
+    std::vector<ConcentrationSketches> concentration;   // [region * parameters.size() + parametr]
+};
 
 //******************************************************************************************
-// Obsługa zapisu/odczytu danych lokalnych (DB)
+// Prosta analiza danych historycznych
 //******************************************************************************************
 
-/// Wczytuje dane stacji z podanego pliku
-bool LoadDB(const std::string& fn, std::vector<std::string>& dates, Station& station) {
-    std::ifstream in("savefiles/" + fn);
-    if (!in) return false;
+/// Sumy i ekstrema z jednego przebiegu po ciągłej tablicy wartości (x = numer próbki).
+/// Sumy liczone są dla d = y - shift (shift = pierwsza wartość), co ogranicza utratę precyzji wariancji.
+struct ValueMoments {
+    size_t n = 0;
+    double shift = 0;
+    double sum = 0, sumSq = 0, sumXY = 0;   // Σd, Σd², Σx·d
+    double min = 0, max = 0;
+    size_t argmin = 0, argmax = 0;          // pierwsze minimum, ostatnie maksimum (jak minmax_element)
+};
 
-    try {
-        auto j = json::parse(in);
-        station = Station();
-        auto& station_data = j["station"];
-        station.id = station_data["id"];
-        station.name = station_data["stationName"];
-        station.city = station_data["city"];
-        station.region = station_data["region"];
-        station.lat = station_data["lat"];
-        station.lon = station_data["lon"];
-        station.history = station_data["history"].get<std::vector<double>>();
+/// Łączy ekstrema z torów wektorowych: mniejsza wartość (przy remisie wcześniejszy indeks) dla minimum,
+/// większa (przy remisie późniejszy indeks) dla maksimum
+static void ReduceLanes(const double* mins, const double* minIdx, const double* maxs, const double* maxIdx, int lanes, ValueMoments& m) {
+    for (int l = 0; l < lanes; ++l) {
+        const size_t iMin = static_cast<size_t>(minIdx[l]), iMax = static_cast<size_t>(maxIdx[l]);
+        if (mins[l] < m.min || (mins[l] == m.min && iMin < m.argmin)) { m.min = mins[l]; m.argmin = iMin; }
+        if (maxs[l] > m.max || (maxs[l] == m.max && iMax > m.argmax)) { m.max = maxs[l]; m.argmax = iMax; }
+    }
+}
 
-        if (station_data.contains("sensors")) {
-            for (const auto& [sensor_id_str, sensor_data] : station_data["sensors"].items()) {
-                int sensor_id = std::stoi(sensor_id_str);
-                station.sensor_history[sensor_id] = sensor_data["values"].get<std::vector<double>>();
-                station.sensor_names[sensor_id] = sensor_data["name"].get<std::string>();
-            }
-        }
-        dates = j["dates"].get<std::vector<std::string>>();
-        return true;
+#if defined(AQI_X86)
+/// Część AVX2 jądra analizy: 8 próbek na iterację, dwa zestawy akumulatorów. Dopisuje sumy i ekstrema
+/// do m (m.shift, m.min, m.max już ustawione) i zwraca liczbę przetworzonych próbek.
+AQI_TARGET_AVX2 static size_t MomentsAvx2(const double* y, size_t n, ValueMoments& m) {
+    if (n < 8) return 0;
+    size_t i = 0;
+    const __m256d shift = _mm256_set1_pd(m.shift), step = _mm256_set1_pd(8.0);
+    __m256d idx0 = _mm256_setr_pd(0, 1, 2, 3), idx1 = _mm256_setr_pd(4, 5, 6, 7);
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, q0 = s0, q1 = s0, xy0 = s0, xy1 = s0;
+    __m256d mn0 = _mm256_set1_pd(m.shift), mn1 = mn0, mx0 = mn0, mx1 = mn0;
+    __m256d amn0 = _mm256_setzero_pd(), amn1 = amn0, amx0 = amn0, amx1 = amn0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256d v0 = _mm256_loadu_pd(y + i), v1 = _mm256_loadu_pd(y + i + 4);
+        const __m256d d0 = _mm256_sub_pd(v0, shift), d1 = _mm256_sub_pd(v1, shift);
+        s0 = _mm256_add_pd(s0, d0);
+        s1 = _mm256_add_pd(s1, d1);
+        q0 = _mm256_add_pd(q0, _mm256_mul_pd(d0, d0));
+        q1 = _mm256_add_pd(q1, _mm256_mul_pd(d1, d1));
+        xy0 = _mm256_add_pd(xy0, _mm256_mul_pd(idx0, d0));
+        xy1 = _mm256_add_pd(xy1, _mm256_mul_pd(idx1, d1));
+        const __m256d lt0 = _mm256_cmp_pd(v0, mn0, _CMP_LT_OQ), lt1 = _mm256_cmp_pd(v1, mn1, _CMP_LT_OQ);
+        mn0 = _mm256_blendv_pd(mn0, v0, lt0);
+        mn1 = _mm256_blendv_pd(mn1, v1, lt1);
+        amn0 = _mm256_blendv_pd(amn0, idx0, lt0);
+        amn1 = _mm256_blendv_pd(amn1, idx1, lt1);
+        const __m256d ge0 = _mm256_cmp_pd(v0, mx0, _CMP_GE_OQ), ge1 = _mm256_cmp_pd(v1, mx1, _CMP_GE_OQ);
+        mx0 = _mm256_blendv_pd(mx0, v0, ge0);
+        mx1 = _mm256_blendv_pd(mx1, v1, ge1);
+        amx0 = _mm256_blendv_pd(amx0, idx0, ge0);
+        amx1 = _mm256_blendv_pd(amx1, idx1, ge1);
+        idx0 = _mm256_add_pd(idx0, step);
+        idx1 = _mm256_add_pd(idx1, step);
     }
-    catch (...) {
-        return false;
+    alignas(32) double lanes[4][8];
+    _mm256_store_pd(lanes[0], _mm256_add_pd(s0, s1));
+    _mm256_store_pd(lanes[0] + 4, _mm256_add_pd(q0, q1));
+    _mm256_store_pd(lanes[1], _mm256_add_pd(xy0, xy1));
+    for (int l = 0; l < 4; ++l) {
+        m.sum += lanes[0][l];
+        m.sumSq += lanes[0][4 + l];
+        m.sumXY += lanes[1][l];
     }
+    _mm256_store_pd(lanes[0], mn0);
+    _mm256_store_pd(lanes[0] + 4, mn1);
+    _mm256_store_pd(lanes[1], amn0);
+    _mm256_store_pd(lanes[1] + 4, amn1);
+    _mm256_store_pd(lanes[2], mx0);
+    _mm256_store_pd(lanes[2] + 4, mx1);
+    _mm256_store_pd(lanes[3], amx0);
+    _mm256_store_pd(lanes[3] + 4, amx1);
+    ReduceLanes(lanes[0], lanes[1], lanes[2], lanes[3], 8, m);
+    return i;
 }
+#endif
 
-///KONWERSJA Z U8 NA 16
-std::wstring Utf8ToUtf16(const std::string& utf8)
-{
-    if (utf8.empty()) return {};
-    int wsz = MultiByteToWideChar(
-        CP_UTF8, 0,
-        utf8.data(), (int)utf8.size(),
-        nullptr, 0
-    );
-    std::wstring wstr;
-    wstr.resize(wsz);
-    MultiByteToWideChar(
-        CP_UTF8, 0,
-        utf8.data(), (int)utf8.size(),
-        &wstr[0], wsz
-    );
-    return wstr;
+#if defined(AQI_SSE2)
+/// Część SSE2 jądra analizy: 4 próbki na iterację, dwa zestawy akumulatorów (jak MomentsAvx2)
+static size_t MomentsSse2(const double* y, size_t n, ValueMoments& m) {
+    if (n < 4) return 0;
+    size_t i = 0;
+    // SSE2 nie ma blendv – wybór przez and/andnot/or
+    auto select = [](__m128d mask, __m128d a, __m128d b) { return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a)); };
+    const __m128d shift = _mm_set1_pd(m.shift), step = _mm_set1_pd(4.0);
+    __m128d idx0 = _mm_setr_pd(0, 1), idx1 = _mm_setr_pd(2, 3);
+    __m128d s0 = _mm_setzero_pd(), s1 = s0, q0 = s0, q1 = s0, xy0 = s0, xy1 = s0;
+    __m128d mn0 = _mm_set1_pd(m.shift), mn1 = mn0, mx0 = mn0, mx1 = mn0;
+    __m128d amn0 = _mm_setzero_pd(), amn1 = amn0, amx0 = amn0, amx1 = amn0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128d v0 = _mm_loadu_pd(y + i), v1 = _mm_loadu_pd(y + i + 2);
+        const __m128d d0 = _mm_sub_pd(v0, shift), d1 = _mm_sub_pd(v1, shift);
+        s0 = _mm_add_pd(s0, d0);
+        s1 = _mm_add_pd(s1, d1);
+        q0 = _mm_add_pd(q0, _mm_mul_pd(d0, d0));
+        q1 = _mm_add_pd(q1, _mm_mul_pd(d1, d1));
+        xy0 = _mm_add_pd(xy0, _mm_mul_pd(idx0, d0));
+        xy1 = _mm_add_pd(xy1, _mm_mul_pd(idx1, d1));
+        const __m128d lt0 = _mm_cmplt_pd(v0, mn0), lt1 = _mm_cmplt_pd(v1, mn1);
+        mn0 = select(lt0, mn0, v0);
+        mn1 = select(lt1, mn1, v1);
+        amn0 = select(lt0, amn0, idx0);
+        amn1 = select(lt1, amn1, idx1);
+        const __m128d ge0 = _mm_cmpge_pd(v0, mx0), ge1 = _mm_cmpge_pd(v1, mx1);
+        mx0 = select(ge0, mx0, v0);
+        mx1 = select(ge1, mx1, v1);
+        amx0 = select(ge0, amx0, idx0);
+        amx1 = select(ge1, amx1, idx1);
+        idx0 = _mm_add_pd(idx0, step);
+        idx1 = _mm_add_pd(idx1, step);
+    }
+    alignas(16) double lanes[4][4];
+    _mm_store_pd(lanes[0], _mm_add_pd(s0, s1));
+    _mm_store_pd(lanes[0] + 2, _mm_add_pd(q0, q1));
+    _mm_store_pd(lanes[1], _mm_add_pd(xy0, xy1));
+    for (int l = 0; l < 2; ++l) {
+        m.sum += lanes[0][l];
+        m.sumSq += lanes[0][2 + l];
+        m.sumXY += lanes[1][l];
+    }
+    _mm_store_pd(lanes[0], mn0);
+    _mm_store_pd(lanes[0] + 2, mn1);
+    _mm_store_pd(lanes[1], amn0);
+    _mm_store_pd(lanes[1] + 2, amn1);
+    _mm_store_pd(lanes[2], mx0);
+    _mm_store_pd(lanes[2] + 2, mx1);
+    _mm_store_pd(lanes[3], amx0);
+    _mm_store_pd(lanes[3] + 2, amx1);
+    ReduceLanes(lanes[0], lanes[1], lanes[2], lanes[3], 4, m);
+    return i;
 }
+#endif
 
-
-/// Zapisuje dane stacji do pliku lokalnego
-void SaveDB(const std::string& fn, const std::vector<std::string>& dates, const Station& station) {
-    try {
-        CreateDirectoryA("savefiles", nullptr);
-        json j;
-        json station_data;
-        station_data["id"] = station.id;
-        station_data["stationName"] = station.name;
-        station_data["city"] = station.city;
-        station_data["region"] = station.region;
-        station_data["lat"] = station.lat;
-        station_data["lon"] = station.lon;
-        station_data["history"] = station.history;
-
-        json sensors_data;
-        for (auto const& [sensor_id, sensor_name] : station.sensor_names) {
-            json sensor_info;
-            sensor_info["name"] = sensor_name;
-            auto it = station.sensor_history.find(sensor_id);
-            if (it != station.sensor_history.end() && !it->second.empty()) {
-                sensor_info["values"] = it->second;
-            }
-            else {
-                try {
-                    json resp = FetchData(sensor_id);
-                    std::vector<double> vals;
-                    for (auto const& entry : resp["values"]) {
-                        if (entry["value"].is_number())
-                            vals.push_back(entry["value"].get<double>());
-                    }
-                    sensor_info["values"] = vals;
-                }
-                catch (const NetworkException&) {
-                    sensor_info["values"] = json::array();
-                }
-            }
-            sensors_data[std::to_string(sensor_id)] = sensor_info;
-        }
-        station_data["sensors"] = sensors_data;
-        j["station"] = station_data;
-        j["dates"] = dates;
-        std::ofstream o("savefiles/" + fn);
-        if (o) o << j.dump(2);
-    }
-    catch (const std::exception& e) {
-        std::wstring mess = Utf8ToUtf16(e.what());
-        MessageBox(nullptr, mess.c_str(), TEXT("Błąd zapisu"), MB_ICONERROR);
+/// Jądro analizy: min, max, argmin/argmax i sumy regresji w jednym przebiegu SIMD
+/// (8 próbek na iterację dla AVX2, 4 dla SSE2 – wg ActiveSimd()); końcówka jest skalarna
+ValueMoments ComputeMoments(const double* y, size_t n) {
+    ValueMoments m;
+    m.n = n;
+    if (n == 0) return m;
+    m.shift = m.min = m.max = y[0];
+    size_t i = 0;
+    const SimdLevel simd = ActiveSimd();
+#if defined(AQI_X86)
+    if (simd == SimdLevel::Avx2) i = MomentsAvx2(y, n, m);
+#endif
+#if defined(AQI_SSE2)
+    if (simd == SimdLevel::Sse2) i = MomentsSse2(y, n, m);
+#endif
+    for (; i < n; ++i) {
+        const double d = y[i] - m.shift;
+        m.sum += d;
+        m.sumSq += d * d;
+        m.sumXY += static_cast<double>(i) * d;
+        if (y[i] < m.min) { m.min = y[i]; m.argmin = i; }
+        if (y[i] >= m.max) { m.max = y[i]; m.argmax = i; }
     }
+    return m;
 }
 
-//******************************************************************************************
-// Prosta analiza danych historycznych
-//******************************************************************************************
+/// Akumuluje statystyki serii kolumnowej jednym przebiegiem jądra ComputeMoments
+OnlineStats ComputeStats(SeriesView v) {
+    OnlineStats s;
+    const ValueMoments m = ComputeMoments(v.values, v.size);
+    if (m.n == 0) return s;
+    const double n = static_cast<double>(m.n);
+    s.n = m.n;
+    s.meanX = (n - 1) / 2;
+    s.meanY = m.shift + m.sum / n;
+    s.m2x = n * (n * n - 1) / 12;
+    s.m2y = std::max(0.0, m.sumSq - m.sum * m.sum / n);
+    s.cxy = m.sumXY - s.meanX * m.sum;
+    s.min = m.min;
+    s.max = m.max;
+    s.minT = v.ts[m.argmin];
+    s.maxT = v.ts[m.argmax];
+    return s;
+}
+
+void SensorSeries::RebuildSummary() {
+    stats = ComputeStats(View());
+    sketch = QuantileSketch::Of(View());
+}
 
-/// Analizuje dane (min, max, średnia, trend) i zwraca wyniki w strukturze Analysis
-Analysis Analyze(const std::vector<std::pair<system_clock::time_point, double>>& d) {
+/// Przekształca akumulator w strukturę Analysis wyświetlaną w UI
+Analysis Summarize(const OnlineStats& s) {
     Analysis A;
-    int n = (int)d.size();
-    if (n == 0) return A;
-    auto mm = minmax_element(d.begin(), d.end(), [](auto& a, auto& b) { return a.second < b.second; });
-    A.min = mm.first->second;
-    A.max = mm.second->second;
-    struct tm tm;
-    auto fmt = [&](auto tp) {
-        time_t t = system_clock::to_time_t(tp);
+    if (s.n == 0) return A;
+    auto fmt = [](int64_t ts) {
+        time_t t = static_cast<time_t>(ts);
+        struct tm tm;
         localtime_s(&tm, &t);
         char buf[64];
         strftime(buf, 64, "%F %T", &tm);
         return std::string(buf);
         };
-    A.minT = fmt(mm.first->first);
-    A.maxT = fmt(mm.second->first);
-    double sum = 0;
-    for (auto& p : d)
-        sum += p.second;
-    A.avg = sum / n;
-    double Sx = 0, Sy = 0, Sxx = 0, Sxy = 0;
-    for (int i = 0; i < n; ++i) {
-        double x = i, y = d[i].second;
-        Sx += x; Sy += y; Sxx += x * x; Sxy += x * y;
+    A.min = s.min;
+    A.max = s.max;
+    A.minT = fmt(s.minT);
+    A.maxT = fmt(s.maxT);
+    A.avg = s.Mean();
+    A.trend = s.Slope();
+    return A;
+}
+
+/// Analizuje dane (min, max, średnia, trend) i zwraca wyniki w strukturze Analysis;
+/// jądro wektorowe przechodzi bezpośrednio po kolumnach serii, bez kopiowania
+Analysis Analyze(SeriesView v) {
+    return Summarize(ComputeStats(v));
+}
+
+/// Agregaty okna przesuwnego: element i opisuje okno czasowe (t_i - okno, t_i] kończące się na próbce i
+struct RollingSeries {
+    std::vector<double> mean, min, max;
+    std::vector<double> slope;   // nachylenie na próbkę, jak trend w Analyze
+};
+
+/// Liczy agregaty wszystkich okien w O(n): min/max z kolejek monotonicznych,
+/// średnią i nachylenie regresji liniowej z sum prefiksowych y oraz i·y
+RollingSeries ComputeRolling(SeriesView v, int64_t windowSeconds) {
+    RollingSeries r;
+    const size_t n = v.size;
+    r.mean.resize(n);
+    r.min.resize(n);
+    r.max.resize(n);
+    r.slope.resize(n);
+
+    std::vector<double> sumY(n + 1, 0.0), sumIY(n + 1, 0.0);
+    for (size_t i = 0; i < n; ++i) {
+        sumY[i + 1] = sumY[i] + v.values[i];
+        sumIY[i + 1] = sumIY[i] + static_cast<double>(i) * v.values[i];
+    }
+
+    std::deque<size_t> minQ, maxQ;   // indeksy o wartościach rosnących (minQ) / malejących (maxQ)
+    size_t lo = 0;
+    for (size_t i = 0; i < n; ++i) {
+        while (v.ts[i] - v.ts[lo] >= windowSeconds) ++lo;
+        while (!minQ.empty() && v.values[minQ.back()] >= v.values[i]) minQ.pop_back();
+        while (!maxQ.empty() && v.values[maxQ.back()] <= v.values[i]) maxQ.pop_back();
+        minQ.push_back(i);
+        maxQ.push_back(i);
+        while (minQ.front() < lo) minQ.pop_front();
+        while (maxQ.front() < lo) maxQ.pop_front();
+
+        // Regresja w układzie x' = x - lo, żeby uniknąć odejmowania dużych sum
+        const double m = static_cast<double>(i - lo + 1);
+        const double sy = sumY[i + 1] - sumY[lo];
+        const double sxy = sumIY[i + 1] - sumIY[lo] - static_cast<double>(lo) * sy;
+        const double sx = m * (m - 1) / 2;
+        const double sxx = (m - 1) * m * (2 * m - 1) / 6;
+        const double den = m * sxx - sx * sx;
+
+        r.mean[i] = sy / m;
+        r.min[i] = v.values[minQ.front()];
+        r.max[i] = v.values[maxQ.front()];
+        r.slope[i] = den > 0 ? (m * sxy - sx * sy) / den : 0.0;
     }
-    A.trend = (n * Sxy - Sx * Sy) / (n * Sxx - Sx * Sx);
-    return A;
+    return r;
 }
 
 //******************************************************************************************
@@ -709,6 +4304,118 @@ bool InitializeFonts(ImGuiIO& io, std::string& errorMsg, bool& showErrorPopup) {
     return true;
 }
 
+//******************************************************************************************
+// Decymacja serii do wykresów (LOD)
+//******************************************************************************************
+
+/// Largest-Triangle-Three-Buckets: zostawia pierwszy i ostatni punkt oraz po jednym punkcie z każdego
+/// z (threshold - 2) kubełków – ten, który z poprzednio wybranym punktem i średnią następnego kubełka
+/// tworzy trójkąt o największym polu. Oś x to numer próbki.
+void DownsampleLTTB(const double* y, size_t n, size_t threshold, std::vector<double>& outX, std::vector<double>& outY) {
+    outX.clear();
+    outY.clear();
+    if (threshold < 3 || threshold >= n) {
+        for (size_t i = 0; i < n; ++i) {
+            outX.push_back(static_cast<double>(i));
+            outY.push_back(y[i]);
+        }
+        return;
+    }
+    const double every = static_cast<double>(n - 2) / (threshold - 2);
+    size_t a = 0;
+    outX.push_back(0.0);
+    outY.push_back(y[0]);
+    for (size_t b = 0; b < threshold - 2; ++b) {
+        const size_t start = static_cast<size_t>(b * every) + 1;
+        const size_t end = std::min(static_cast<size_t>((b + 1) * every) + 1, n - 1);
+        const size_t nextEnd = std::min(static_cast<size_t>((b + 2) * every) + 1, n);
+        double avgX = 0, avgY = 0;
+        for (size_t i = end; i < nextEnd; ++i) {
+            avgX += static_cast<double>(i);
+            avgY += y[i];
+        }
+        const double cnt = static_cast<double>(nextEnd - end);
+        avgX /= cnt;
+        avgY /= cnt;
+
+        const double ax = static_cast<double>(a), ay = y[a];
+        double bestArea = -1;
+        size_t pick = start;
+        for (size_t i = start; i < end; ++i) {
+            const double area = std::abs((ax - avgX) * (y[i] - ay) - (ax - static_cast<double>(i)) * (avgY - ay));
+            if (area > bestArea) {
+                bestArea = area;
+                pick = i;
+            }
+        }
+        outX.push_back(static_cast<double>(pick));
+        outY.push_back(y[pick]);
+        a = pick;
+    }
+    outX.push_back(static_cast<double>(n - 1));
+    outY.push_back(y[n - 1]);
+}
+
+/// Min/max na kubełek (≈ piksel): z każdego kubełka zostają minimum i maksimum w kolejności czasu,
+/// więc żaden szczyt nie znika z wykresu. Oś x to numer próbki.
+void DownsampleMinMax(const double* y, size_t n, size_t buckets, std::vector<double>& outX, std::vector<double>& outY) {
+    outX.clear();
+    outY.clear();
+    if (buckets == 0 || n <= 2 * buckets) {
+        for (size_t i = 0; i < n; ++i) {
+            outX.push_back(static_cast<double>(i));
+            outY.push_back(y[i]);
+        }
+        return;
+    }
+    for (size_t b = 0; b < buckets; ++b) {
+        const size_t start = b * n / buckets, end = (b + 1) * n / buckets;
+        size_t lo = start, hi = start;
+        for (size_t i = start + 1; i < end; ++i) {
+            if (y[i] < y[lo]) lo = i;
+            if (y[i] > y[hi]) hi = i;
+        }
+        const size_t first = std::min(lo, hi), second = std::max(lo, hi);
+        outX.push_back(static_cast<double>(first));
+        outY.push_back(y[first]);
+        if (second != first) {
+            outX.push_back(static_cast<double>(second));
+            outY.push_back(y[second]);
+        }
+    }
+}
+
+/// Punkty wykresu po decymacji do szerokości wykresu w pikselach. Bufor przeliczany jest tylko
+/// po zmianie serii (wersja, początek, długość), szerokości lub trybu; w pozostałych klatkach
+/// wykres korzysta z gotowych tablic.
+struct ChartLod {
+    std::vector<double> x, y;
+
+    void Update(const double* src, size_t n, uint64_t version, int widthPx, bool minMax) {
+        if (src == keySrc && n == keyN && version == keyVersion && widthPx == keyWidth && minMax == keyMinMax)
+            return;
+        const size_t buckets = static_cast<size_t>(std::max(widthPx, 3));
+        if (minMax)
+            DownsampleMinMax(src, n, buckets, x, y);
+        else
+            DownsampleLTTB(src, n, buckets, x, y);
+        keySrc = src;
+        keyN = n;
+        keyVersion = version;
+        keyWidth = widthPx;
+        keyMinMax = minMax;
+    }
+
+    int Size() const { return static_cast<int>(x.size()); }
+
+private:
+    const double* keySrc = nullptr;
+    size_t keyN = 0;
+    uint64_t keyVersion = 0;
+    int keyWidth = -1;
+    bool keyMinMax = false;
+};
+
 /// Przygotowuje współrzędne oraz etykiety na osi X wykresu
 static void PrepareAdaptiveTicksX(int points, const std::vector<const char*>& labels)
 {
@@ -736,6 +4443,435 @@ static void PrepareAdaptiveTicksX(int points, const std::vector<const char*>& la
     ImPlot::SetupAxisTicks(ImAxis_X1, ticks.data(), static_cast<int>(ticks.size()), tick_lbl.data());
 }
 
+/// Model wykresu historii: kolumny serii, średnie kroczące, punkty po decymacji i podziałka osi X.
+/// Update przelicza tylko części, których klucz się zmienił (dane, okres, typ wykresu, szerokość),
+/// a bufory są ponownie wykorzystywane – w ustalonym stanie klatka nie wykonuje alokacji.
+class HistoryChartModel {
+public:
+    /// dataVersion zmienia się przy każdym zastąpieniu lub wyczyszczeniu data (np. zmiana sensora)
+    void Update(const Series& data, uint64_t dataVersion, int days, int plotType, bool ma8, bool ma24, int widthPx) {
+        points = 0;
+        if (data.empty() || days <= 0) return;
+
+        // Kolumny serii; version identyfikuje kolejne wersje danych
+        if (dataVersion != sourceVersion || ts.size() != data.size()) {
+            sourceVersion = dataVersion;
+            ts.resize(data.size());
+            vals.resize(data.size());
+            for (size_t i = 0; i < data.size(); ++i) {
+                ts[i] = system_clock::to_time_t(data[i].first);
+                vals[i] = data[i].second;
+            }
+            ++version;
+        }
+
+        // Średnie kroczące liczone raz dla całej serii
+        showMa8 = ma8;
+        showMa24 = ma24;
+        if ((ma8 || ma24) && rollingVersion != version) {
+            SeriesView view{ ts.data(), vals.data(), ts.size() };
+            rolling8 = ComputeRolling(view, 8 * 3600);
+            rolling24 = ComputeRolling(view, 24 * 3600);
+            rollingVersion = version;
+        }
+
+        const int total = static_cast<int>(vals.size());
+        points = std::min(days, total);
+        start = total - points;
+        bars = plotType == 1;
+
+        // Decymacja do szerokości wykresu: linia przez LTTB, słupki przez min/max na piksel
+        seriesLod.Update(vals.data() + start, points, version, widthPx, bars);
+        if (ma8) ma8Lod.Update(rolling8.mean.data() + start, points, version, widthPx, false);
+        if (ma24) ma24Lod.Update(rolling24.mean.data() + start, points, version, widthPx, false);
+
+        if (tickStart != start || tickPoints != points || tickVersion != version || tickWidth != widthPx)
+            RebuildTicks(widthPx);
+    }
+
+    void Draw() const {
+        if (points == 0) return;
+        if (ImPlot::BeginPlot("##HistoryChart", ImVec2(-1, 300))) {
+            if (ticks.size() >= 2)
+                ImPlot::SetupAxisTicks(ImAxis_X1, ticks.data(), static_cast<int>(ticks.size()), tickLabels.data());
+            ImPlot::SetupAxes("Data", "Wartość", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+            if (!bars) {
+                ImPlot::PlotLine("##Series", seriesLod.x.data(), seriesLod.y.data(), seriesLod.Size());
+            }
+            else {
+                ImPlot::PlotBars("##Bars", seriesLod.x.data(), seriesLod.y.data(), seriesLod.Size(), 0.7);
+            }
+            if (showMa8) {
+                ImPlot::PlotLine("Średnia 8h", ma8Lod.x.data(), ma8Lod.y.data(), ma8Lod.Size());
+            }
+            if (showMa24) {
+                ImPlot::PlotLine("Średnia 24h", ma24Lod.x.data(), ma24Lod.y.data(), ma24Lod.Size());
+            }
+            ImPlot::EndPlot();
+        }
+    }
+
+private:
+    /// Wyznacza podziałkę tak, by etykiety się nie nakładały; formatuje tylko etykiety wybranych podziałek
+    void RebuildTicks(int widthPx) {
+        ticks.clear();
+        tickText.clear();
+        tickLabels.clear();
+        tickStart = start;
+        tickPoints = points;
+        tickVersion = version;
+        tickWidth = widthPx;
+        if (points < 2) return;
+
+        const float px_per_unit = static_cast<float>(widthPx) / (points - 1);
+        const float label_w = ImGui::CalcTextSize("00/00 00:00").x;
+        const int step = std::max(1, static_cast<int>(std::ceil(label_w / std::max(px_per_unit, 1e-3f))));
+        for (int i = 0; i < points; i += step)
+            ticks.push_back(static_cast<double>(i));
+        if (ticks.size() < 2) {
+            ticks.clear();
+            ticks.push_back(0.0);
+            ticks.push_back(static_cast<double>(points - 1));
+        }
+        tickText.resize(ticks.size());
+        for (size_t k = 0; k < ticks.size(); ++k) {
+            time_t t = static_cast<time_t>(ts[start + static_cast<size_t>(ticks[k])]);
+            struct tm tm_time;
+            localtime_s(&tm_time, &t);
+            strftime(tickText[k].data(), tickText[k].size(), "%d/%m %H:%M", &tm_time);
+        }
+        for (const auto& text : tickText)
+            tickLabels.push_back(text.data());
+    }
+
+    std::vector<int64_t> ts;
+    std::vector<double> vals;
+    uint64_t version = 0;
+    uint64_t sourceVersion = UINT64_MAX;   // dataVersion, z którego zbudowano kolumny
+
+    RollingSeries rolling8, rolling24;
+    uint64_t rollingVersion = 0;
+    bool showMa8 = false, showMa24 = false;
+
+    int points = 0, start = 0;
+    bool bars = false;
+    ChartLod seriesLod, ma8Lod, ma24Lod;
+
+    std::vector<double> ticks;
+    std::vector<std::array<char, 32>> tickText;
+    std::vector<const char*> tickLabels;
+    int tickStart = -1, tickPoints = -1, tickWidth = -1;
+    uint64_t tickVersion = 0;
+};
+
+/// Model listy stacji: etykiety wierszy formatowane raz na zmianę danych, kolejność sortowania
+/// i wynik filtra jako listy indeksów. Zmiana filtra lub sortowania nie formatuje etykiet ponownie,
+/// a Draw przez ImGuiListClipper dotyka tylko widocznych wierszy
+class StationListModel {
+public:
+    enum SortKey { SortNone = 0, SortName = 1, SortIndex = 2 };
+
+    /// Dopasowuje wiersze do opublikowanej wersji listy. Wersje współdzielą niezmienione stacje,
+    /// więc zmienione wiersze rozpoznawane są po wskaźnikach; podmiana całej listy przebudowuje model
+    void Sync(const StationSnapshot& snap) {
+        if (snap.version == syncedVersion) return;
+        syncedVersion = snap.version;
+
+        bool rebuild = snap.Size() < rows.size();
+        changed.clear();
+        for (size_t i = 0; i < snap.Size() && !rebuild; ++i) {
+            if (i >= rows.size() || rows[i].source != snap.stations[i]) {
+                if (i < rows.size() && rows[i].id != snap[i].id) rebuild = true;
+                changed.push_back(i);
+            }
+        }
+        if (rebuild || changed.size() > kMaxIncremental) {
+            Reset(snap);
+            return;
+        }
+        if (changed.empty()) return;
+        for (size_t i : changed)
+            Refresh(snap, i);
+        Refilter();
+    }
+
+    /// Ustawia filtr (fragment nazwy, miasta lub województwa, bez rozróżniania wielkości liter i polskich znaków).
+    /// Zawężenie bieżącego filtra przegląda tylko wiersze, które go już spełniają
+    void SetFilter(const char* text) {
+        std::string next = FoldKey(text);
+        if (next == filter) return;
+        const bool narrowing = next.find(filter) != std::string::npos;
+        filter = std::move(next);
+        if (!narrowing) {
+            Refilter();
+            return;
+        }
+        visible.erase(std::remove_if(visible.begin(), visible.end(),
+            [this](int i) { return !Matches(rows[i]); }), visible.end());
+    }
+
+    /// Zmienia klucz sortowania; sortowane są same indeksy po zbuforowanych kluczach
+    void SetSort(int key) {
+        if (key == sortKey) return;
+        sortKey = key;
+        SortOrder(order);
+        SortOrder(visible);
+    }
+
+    size_t VisibleCount() const { return visible.size(); }
+    size_t TotalCount() const { return rows.size(); }
+
+    /// Rysuje widoczne wiersze; zwraca indeks klikniętej stacji albo -1
+    int Draw(int selected) const {
+        int clicked = -1;
+        ImGuiListClipper clipper;
+        clipper.Begin(static_cast<int>(visible.size()));
+        while (clipper.Step()) {
+            for (int k = clipper.DisplayStart; k < clipper.DisplayEnd; ++k) {
+                const int i = visible[k];
+                ImGui::PushID(rows[i].id);
+                if (ImGui::Selectable(rows[i].label.c_str(), selected == i))
+                    clicked = i;
+                ImGui::PopID();
+            }
+        }
+        clipper.End();
+        return clicked;
+    }
+
+private:
+    static constexpr size_t kMaxIncremental = 32;   // powyżej tylu zmienionych wierszy taniej jest przebudować model
+
+    struct Row {
+        std::shared_ptr<const Station> source;   // wersja stacji, z której sformatowano wiersz
+        int id = 0;
+        std::string label;      // tekst wyświetlany na liście
+        std::string haystack;   // nazwa, miasto i województwo po FoldKey – do filtrowania
+        std::string sortName;   // nazwa po FoldKey – „Łódź” sortuje się przy „Lodz”, nie za „Z”
+        double latest = 0.0;
+    };
+
+    /// Przebudowuje wszystkie wiersze po podmianie listy stacji
+    void Reset(const StationSnapshot& snap) {
+        rows.clear();
+        rows.reserve(snap.Size());
+        for (const auto& s : snap.stations)
+            rows.push_back(MakeRow(s));
+        order.resize(rows.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = static_cast<int>(i);
+        SortOrder(order);
+        Refilter();
+    }
+
+    /// Formatuje ponownie jeden wiersz (zmieniony lub dopisany na końcu) i przenosi go w kolejności sortowania
+    void Refresh(const StationSnapshot& snap, size_t index) {
+        const int row = static_cast<int>(index);
+        if (index == rows.size())
+            rows.push_back(MakeRow(snap.stations[index]));
+        else {
+            rows[index] = MakeRow(snap.stations[index]);
+            order.erase(std::find(order.begin(), order.end(), row));
+        }
+        order.insert(std::lower_bound(order.begin(), order.end(), row, [this](int a, int b) { return Less(a, b); }), row);
+    }
+
+    static Row MakeRow(const std::shared_ptr<const Station>& source) {
+        const Station& s = *source;
+        Row row;
+        row.source = source;
+        row.id = s.id;
+        row.latest = s.latest();
+        char buf[128];
+        sprintf_s(buf, "%s [%s] - %.1f", s.name.c_str(), s.city.c_str(), row.latest);
+        row.label = buf;
+        row.sortName = FoldKey(s.name);
+        row.haystack = row.sortName + '\n' + FoldKey(s.city) + '\n' + FoldKey(s.region);
+        return row;
+    }
+
+    bool Matches(const Row& row) const {
+        return filter.empty() || row.haystack.find(filter) != std::string::npos;
+    }
+
+    bool Less(int a, int b) const {
+        const Row& ra = rows[a];
+        const Row& rb = rows[b];
+        if (sortKey == SortName && ra.sortName != rb.sortName) return ra.sortName < rb.sortName;
+        if (sortKey == SortIndex && ra.latest != rb.latest) return ra.latest > rb.latest;
+        return a < b;
+    }
+
+    void SortOrder(std::vector<int>& indices) const {
+        std::sort(indices.begin(), indices.end(), [this](int a, int b) { return Less(a, b); });
+    }
+
+    void Refilter() {
+        visible.clear();
+        for (int i : order)
+            if (Matches(rows[i])) visible.push_back(i);
+    }
+
+    std::vector<Row> rows;       // indeks wiersza = pozycja stacji na liście stations
+    std::vector<int> order;      // wszystkie wiersze w kolejności sortowania
+    std::vector<int> visible;    // podciąg order spełniający filtr
+    std::vector<size_t> changed;
+    std::string filter;
+    int sortKey = SortNone;
+    uint64_t syncedVersion = 0;
+};
+
+//******************************************************************************************
+// Autotesty i pomiary wydajności (przełączniki --selftest, --bench)
+//******************************************************************************************
+
+/// Porównuje HaversineBatch z referencyjnym Haversine() dla siatki środków i punktów w odległościach
+/// od ułamków metra do ~19 000 km, osobno dla każdego poziomu SIMD obsługiwanego przez procesor.
+/// Liczba punktów nie jest wielokrotnością 4, więc sprawdzana jest też skalarna końcówka.
+/// Zwraca liczbę rozbieżności, opisy dopisuje do report.
+int SelfTestHaversineBatch(std::ostream& report) {
+    constexpr double kAbsTolKm = 1e-7;   // 0.1 mm
+    constexpr double kRelTol = 1e-9;
+    const double offsetsDeg[] = { 0.0, 1e-7, 1e-6, 1e-5, 1e-4, 1e-3, 0.01, 0.1, 1.0, 10.0, 45.0, 90.0, 170.0 };
+
+    int failures = 0;
+    for (int level = 0; level <= static_cast<int>(DetectSimd()); ++level) {
+        const SimdLevel simd = static_cast<SimdLevel>(level);
+        SetSimdLimit(simd);
+        for (double cLat = -80.0; cLat <= 80.0; cLat += 20.0) {
+            for (double cLon = -170.0; cLon <= 170.0; cLon += 40.0) {
+                std::vector<std::pair<double, double>> pts;
+                for (double d : offsetsDeg) {
+                    pts.push_back({ std::min(89.9, cLat + d / 2), cLon });
+                    pts.push_back({ cLat, cLon + d });
+                    pts.push_back({ std::max(-89.9, cLat - d / 3), cLon - d / 2 });
+                }
+                pts.push_back({ 52.2297, 21.0122 });   // Warszawa
+                pts.push_back({ -33.8688, 151.2093 }); // Sydney – 41 punktów, reszta z dzielenia przez 4 i 2
+
+                GeoPointsSoA soa;
+                soa.Reserve(pts.size());
+                for (const auto& p : pts)
+                    soa.Add(p.first, p.second);
+                std::vector<double> got(pts.size());
+                HaversineBatch(cLat, cLon, soa, got.data());
+
+                for (size_t i = 0; i < pts.size(); ++i) {
+                    const double want = Haversine(cLat, cLon, pts[i].first, pts[i].second);
+                    if (std::fabs(got[i] - want) > kAbsTolKm + kRelTol * want) {
+                        ++failures;
+                        report << std::setprecision(17) << "HaversineBatch [" << SimdName(simd) << "] (" << cLat << ", " << cLon << ") -> ("
+                            << pts[i].first << ", " << pts[i].second << "): " << got[i] << " km, oczekiwano " << want << " km\n";
+                    }
+                }
+            }
+        }
+    }
+    SetSimdLimit(SimdLevel::Avx2);
+    return failures;
+}
+
+/// Uruchamia autotesty, zapisuje raport do selftest.txt i pokazuje podsumowanie. Zwraca liczbę błędów.
+int RunSelfTests() {
+    std::ostringstream report;
+    int failures = SelfTestHaversineBatch(report);
+    report << (failures == 0 ? "OK" : "BŁĘDY: " + std::to_string(failures)) << "\n";
+
+    std::ofstream("selftest.txt") << report.str();
+    MessageBox(nullptr, failures == 0 ? TEXT("Autotesty zakończone powodzeniem") : TEXT("Autotesty wykryły błędy – szczegóły w selftest.txt"),
+        TEXT("Autotesty"), failures == 0 ? MB_ICONINFORMATION : MB_ICONERROR);
+    return failures;
+}
+
+/// Pierwotna implementacja Analyze (przed jądrem kolumnowym) – punkt odniesienia dla --bench
+static Analysis AnalyzeBaseline(const Series& d) {
+    Analysis A;
+    int n = (int)d.size();
+    if (n == 0) return A;
+    auto mm = minmax_element(d.begin(), d.end(), [](auto& a, auto& b) { return a.second < b.second; });
+    A.min = mm.first->second;
+    A.max = mm.second->second;
+    struct tm tm;
+    auto fmt = [&](auto tp) {
+        time_t t = system_clock::to_time_t(tp);
+        localtime_s(&tm, &t);
+        char buf[64];
+        strftime(buf, 64, "%F %T", &tm);
+        return std::string(buf);
+        };
+    A.minT = fmt(mm.first->first);
+    A.maxT = fmt(mm.second->first);
+    double sum = 0;
+    for (auto& p : d)
+        sum += p.second;
+    A.avg = sum / n;
+    double Sx = 0, Sy = 0, Sxx = 0, Sxy = 0;
+    for (int i = 0; i < n; ++i) {
+        double x = i, y = d[i].second;
+        Sx += x; Sy += y; Sxx += x * x; Sxy += x * y;
+    }
+    A.trend = (n * Sxy - Sx * Sy) / (n * Sxx - Sx * Sx);
+    return A;
+}
+
+/// Porównuje Analyze na kolumnach serii z pierwotną implementacją (AnalyzeBaseline na wektorze par)
+/// dla serii od 1 tys. do 10 mln próbek, osobno dla każdego poziomu SIMD obsługiwanego przez procesor.
+/// Wyniki (ns/próbkę, przyspieszenie, zgodność) trafiają do bench.txt.
+int RunBenchmarks() {
+    using Clock = steady_clock;
+    std::ostringstream report;
+    report << "próbki;jądro;stare ns/próbkę;nowe ns/próbkę;przyspieszenie;zgodne\n";
+
+    int mismatches = 0;
+    for (size_t n : { size_t(1000), size_t(10000), size_t(100000), size_t(1000000), size_t(10000000) }) {
+        // Syntetyczna seria minutowa (10 mln godzin nie zmieści się w time_point o rozdzielczości ns):
+        // dobowy cykl z szumem z generatora liniowego
+        Series points(n);
+        SensorSeries columns;
+        columns.Reserve(n);
+        uint64_t lcg = 12345;
+        for (size_t i = 0; i < n; ++i) {
+            lcg = lcg * 6364136223846793005ull + 1442695040888963407ull;
+            const double noise = static_cast<double>(lcg >> 11) / 9007199254740992.0 - 0.5;
+            const double v = 30 + 15 * std::sin(static_cast<double>(i) * 2 * PI / 1440) + 5 * noise;
+            const int64_t t = 1700000000 + static_cast<int64_t>(i) * 60;
+            points[i] = { system_clock::from_time_t(static_cast<time_t>(t)), v };
+            columns.Append(t, v);
+        }
+        const int reps = static_cast<int>(std::max<size_t>(3, 20000000 / n));
+
+        Analysis before;
+        auto t0 = Clock::now();
+        for (int r = 0; r < reps; ++r)
+            before = AnalyzeBaseline(points);
+        const double oldNs = duration<double, std::nano>(Clock::now() - t0).count() / (static_cast<double>(reps) * n);
+
+        for (int level = 0; level <= static_cast<int>(DetectSimd()); ++level) {
+            const SimdLevel simd = static_cast<SimdLevel>(level);
+            SetSimdLimit(simd);
+            Analysis after;
+            auto t1 = Clock::now();
+            for (int r = 0; r < reps; ++r)
+                after = Analyze(columns.View());
+            const double newNs = duration<double, std::nano>(Clock::now() - t1).count() / (static_cast<double>(reps) * n);
+
+            auto close = [](double a, double b) { return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::fabs(a)); };
+            const bool same = before.min == after.min && before.max == after.max && before.minT == after.minT &&
+                before.maxT == after.maxT && close(before.avg, after.avg) && close(before.trend, after.trend);
+            if (!same) ++mismatches;
+            report << n << ";" << SimdName(simd) << ";" << std::fixed << std::setprecision(3) << oldNs << ";" << newNs << ";"
+                << std::setprecision(2) << oldNs / newNs << ";" << (same ? "tak" : "NIE") << "\n";
+            report.unsetf(std::ios::floatfield);
+        }
+        SetSimdLimit(SimdLevel::Avx2);
+    }
+
+    std::ofstream("bench.txt") << report.str();
+    MessageBox(nullptr, mismatches == 0 ? TEXT("Pomiary zapisano w bench.txt") : TEXT("Wyniki jądra analizy różnią się – szczegóły w bench.txt"),
+        TEXT("Pomiary wydajności"), mismatches == 0 ? MB_ICONINFORMATION : MB_ICONERROR);
+    return mismatches;
+}
+
 //******************************************************************************************
 // Funkcja WinMain oraz GUI aplikacji
 //******************************************************************************************
@@ -743,6 +4879,11 @@ static void PrepareAdaptiveTicksX(int points, const std::vector<const char*>& la
 
 int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdLine, int nCmdShow) {
 
+    if (lpCmdLine && _tcsstr(lpCmdLine, _T("--selftest")))
+        return RunSelfTests();
+    if (lpCmdLine && _tcsstr(lpCmdLine, _T("--bench")))
+        return RunBenchmarks();
+
     // Ustawienia lokalne
     std::setlocale(LC_ALL, "pl_PL.UTF-8");
     std::setlocale(LC_CTYPE, "pl_PL.UTF-8");
@@ -818,7 +4959,7 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
 
     // Zmienne stanu aplikacji
     std::vector<std::string> dates;
-    std::vector<Station> stations;
+    StationStore& store = StationStore::Instance();   // opublikowane wersje listy stacji
     int fetchMode = 0;
     char cityBuf[64] = {};
     char addrBuf[128] = {};
@@ -827,10 +4968,142 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
     int selSensor = -1;
     std::vector<Sensor> sensors;
     std::vector<std::pair<system_clock::time_point, double>> data;
+    uint64_t dataVersion = 0;   // zwiększany przy każdym zastąpieniu lub wyczyszczeniu data
     Analysis analysis;
+    QuantileSketch seriesQuantiles;   // skompresowana kopia szkicu wyświetlanej serii – odczyt w klatce bez scalania
     int days = 50;
     int plotType = 0;
     bool onlineMode = IsInternetAvailable();
+    StationFetchEngine fetchEngine;
+    std::map<int, Series> fetchedSeries;   // serie pobrane w tle dla wybranej stacji
+    bool fetchingStations = false;
+    bool stationsNearestOnly = false;   // lista to najbliższe stacje spoza żądanego promienia
+    /// Wynik pobrania listy stacji w tle
+    struct StationFetchResult {
+        std::shared_ptr<StationSnapshot> snapshot;
+        bool nearestOnly = false;
+    };
+    std::shared_ptr<const StationCatalog> cityCatalog;   // katalog do podpowiedzi miast, dostępny po pierwszym pobraniu
+    int pendingSensorFetches = 0;
+    // Tokeny bieżących żądań: nowsze żądanie dla tego samego widoku anuluje poprzednie
+    CancellationToken stationsFetch;   // lista stacji ("Pobierz dane")
+    CancellationToken sensorsFetch;    // sensory i prefetch serii wybranej stacji
+    CancellationToken seriesFetch;     // pojedyncza seria wybranego sensora
+    int seriesFetchSensor = -1;        // sensor, którego serię pobiera seriesFetch
+    bool journalEnabled = false;   // dopisywanie nowych próbek do dziennika journal/
+    std::shared_ptr<const SnapshotArchive> archive;   // archiwum migawek, wczytywane w tle przy pierwszym otwarciu
+    bool loadingArchive = false;
+
+    StationListModel stationList;                   // etykiety, sortowanie i filtr listy stacji
+    char stationFilter[64] = {};
+    int stationSort = StationListModel::SortNone;
+
+    auto selectedStationId = [&]() {
+        auto snap = store.Current();
+        return selStation >= 0 && selStation < static_cast<int>(snap->Size()) ? (*snap)[selStation].id : -1;
+        };
+
+    /// Ustawia serię jako aktualnie wyświetlane dane sensora: przycina ją do okresu, aktualizuje historię i analizę
+    auto applySeries = [&](int stationId, int sensorId, const Series& series) {
+        data = series;
+        ++dataVersion;
+        if (data.empty()) {
+            errorMsg = u8"Brak prawidłowych danych do wyświetlenia";
+            showErrorPopup = true;
+            return;
+        }
+        time_t last_time = system_clock::to_time_t(data.back().first);
+        std::tm last_tm;
+        localtime_s(&last_tm, &last_time);
+        char buf[64];
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H", &last_tm);
+        dates.push_back(buf);
+        SensorSeries columns;
+        columns.Assign(series);
+        seriesQuantiles = columns.Sketch();
+        seriesQuantiles.Compress();
+        // Okres wybrany suwakiem zostaje, dopóki mieści się w zakresie suwaka dla nowej serii
+        days = std::clamp(days, 2, std::max(2, static_cast<int>(data.size())));
+        // Średnia i analiza obejmują ostatnie `days` punktów; wykres dostaje całą serię.
+        // Gdy okres obejmuje całą serię, wystarczają statystyki utrzymywane przez nią samą
+        const size_t window = std::min(static_cast<size_t>(days), columns.Size());
+        analysis = window == columns.Size() ? Summarize(columns.Stats()) : Analyze(columns.Last(window));
+        auto updated = store.Update(stationId, [&](Station& station) {
+            station.history.Append(data.back().first, analysis.avg);
+            station.history.TrimToDays(kHistoryRetentionDays);
+            station.sensors.At(sensorId) = columns;
+            });
+        if (updated && journalEnabled)
+            SeriesJournal::Instance().Append(stationId, 0, updated->history.View());
+        };
+
+    /// Wywołania zwrotne silnika pobierania, wykonywane w wątku UI
+    StationFetchEngine::Callbacks sensorCallbacks;
+    sensorCallbacks.onSensors = [&](int stationId, const std::vector<Sensor>& list) {
+        auto updated = store.Update(stationId, [&](Station& st) {
+            for (const auto& sensor : list)
+                st.sensors.SetName(sensor.id, sensor.name);
+            });
+        if (updated && journalEnabled)
+            SeriesJournal::Instance().WriteMeta(*updated);
+        if (selectedStationId() == stationId) {
+            sensors = list;
+            pendingSensorFetches = static_cast<int>(list.size());
+        }
+        };
+    sensorCallbacks.onSeries = [&](int stationId, int sensorId, Series series) {
+        if (journalEnabled) {
+            SensorSeries journaled;
+            journaled.Assign(series);
+            SeriesJournal::Instance().Append(stationId, sensorId, journaled.View());
+        }
+        if (selectedStationId() != stationId) return;
+        pendingSensorFetches = std::max(0, pendingSensorFetches - 1);
+        // Seria czeka w pamięci; wybrany sensor, który nie ma jeszcze danych, dostaje ją od razu
+        if (data.empty() && selSensor >= 0 && selSensor < static_cast<int>(sensors.size()) && sensors[selSensor].id == sensorId) {
+            applySeries(stationId, sensorId, series);
+        }
+        fetchedSeries[sensorId] = std::move(series);
+        };
+    sensorCallbacks.onSeriesError = [&](int stationId, int sensorId, const std::string& what) {
+        if (selectedStationId() != stationId) return;
+        pendingSensorFetches = std::max(0, pendingSensorFetches - 1);
+        if (selSensor >= 0 && selSensor < static_cast<int>(sensors.size()) && sensors[selSensor].id == sensorId) {
+            errorMsg = u8"Błąd pobierania: " + what;
+            showErrorPopup = true;
+        }
+        };
+    sensorCallbacks.onError = [&](int stationId, const std::string& what) {
+        errorMsg = u8"Błąd sieciowy: " + what;
+        showErrorPopup = true;
+        onlineMode = false;
+        auto snap = store.Current();
+        const int pos = snap->Find(stationId);
+        const Station* st = pos >= 0 ? &(*snap)[pos] : nullptr;
+        if (selectedStationId() == stationId && st && !st->sensors.Empty()) {
+            sensors.clear();
+            for (size_t i = 0; i < st->sensors.Size(); ++i) {
+                const auto& values = st->sensors.SeriesAt(i);
+                if (!values.Empty()) {
+                    const int sensor_id = st->sensors.IdAt(i);
+                    sensors.push_back({ sensor_id, "Sensor #" + std::to_string(sensor_id) + " (" + std::to_string(values.Size()) + " rekordów)" });
+                }
+            }
+        }
+        };
+    sensorCallbacks.onDone = [&](int stationId) {
+        if (selectedStationId() == stationId) {
+            pendingSensorFetches = 0;
+            seriesFetchSensor = -1;
+        }
+        };
+    /// Anuluje pobieranie danych poprzednio wybranej stacji (także trwające zapytania HTTP)
+    auto cancelStationFetches = [&]() {
+        sensorsFetch.Cancel();
+        seriesFetch.Cancel();
+        seriesFetchSensor = -1;
+        pendingSensorFetches = 0;
+        };
 
     if (!IsInternetAvailable()) {
         errorMsg = u8"Brak połączenia z Internetem!";
@@ -846,36 +5119,46 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
     ShowWindow(hwnd, nCmdShow);
     UpdateWindow(hwnd);
 
-    // Główna pętla komunikatów
+    // Główna pętla komunikatów. Klatki renderowane są tylko po wejściu użytkownika,
+    // nadejściu wyników z tła lub w trakcie interakcji; w bezczynności pętla śpi
+    // w MsgWaitForMultipleObjectsEx i odświeża okno rzadko (kIdleFrameMs)
+    constexpr DWORD kIdleFrameMs = 1000;
+    constexpr auto kActiveWindow = milliseconds(250);   // pełne odświeżanie po ostatnim zdarzeniu (animacje ImGui)
+    HANDLE wakeHandle = ui_queue.WakeHandle();
+    auto activeUntil = steady_clock::now() + kActiveWindow;
     MSG msg;
-    while (true) {
-        if (PeekMessage(&msg, nullptr, 0U, 0U, PM_REMOVE)) {
-            if (msg.message == WM_QUIT)
+    bool running = true;
+    while (running) {
+        bool activity = false;
+        while (PeekMessage(&msg, nullptr, 0U, 0U, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) {
+                running = false;
                 break;
+            }
             TranslateMessage(&msg);
             DispatchMessage(&msg);
-            continue;
+            activity = true;
         }
+        if (!running)
+            break;
 
+        // Wyniki zadań działających w tle
+        if (ui_queue.Drain())
+            activity = true;
 
-        if (is_fetching_stations && stations_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-            try {
-                auto result = stations_future.get();
-                {
-                    std::lock_guard<std::mutex> lock(stations_mutex);
-                    stations = result;
-                    dates.clear();
-                    errorMsg = u8"Pobrano nowe dane!";
-                    showErrorPopup = true;
-                }
-            }
-            catch (const std::exception& e) {
-                errorMsg = u8"Błąd sieciowy: " + std::string(e.what());
-                showErrorPopup = true;
-            }
-            is_fetching_stations = false;
+        if (activity)
+            activeUntil = steady_clock::now() + kActiveWindow;
+        else if (steady_clock::now() >= activeUntil && wakeHandle) {
+            // Nic się nie dzieje – czekamy na komunikat, sygnał z ui_queue albo upływ kIdleFrameMs
+            DWORD wait = MsgWaitForMultipleObjectsEx(1, &wakeHandle, kIdleFrameMs, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+            if (wait != WAIT_TIMEOUT)
+                continue;
         }
 
+        // Spójna wersja listy stacji na całą klatkę – odczyt bez blokad
+        const std::shared_ptr<const StationSnapshot> snap = store.Current();
+        stationList.Sync(*snap);
+
         // Rozpoczęcie nowej ramki ImGui
         ImGui_ImplDX11_NewFrame();
         ImGui_ImplWin32_NewFrame();
@@ -917,36 +5200,73 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
                 ImGui::RadioButton("W promieniu", &fetchMode, 2);
                 if (fetchMode == 1) {
                     ImGui::InputText("Miasto", cityBuf, IM_ARRAYSIZE(cityBuf));
+                    // Podpowiedzi: stacje, których miasto lub nazwa zaczyna się od wpisanego tekstu;
+                    // wybór podstawia miasto stacji (po nim filtruje FetchByCity)
+                    if (cityCatalog && cityBuf[0] != '\0') {
+                        const std::string typed = FoldKey(cityBuf);
+                        std::vector<std::string> shown;
+                        for (const Station* st : cityCatalog->PrefixSearch(cityBuf, 20)) {
+                            if (shown.size() == 5) break;
+                            if (FoldKey(st->city) == typed || std::find(shown.begin(), shown.end(), st->city) != shown.end())
+                                continue;
+                            shown.push_back(st->city);
+                            std::string label = st->city;
+                            if (FoldKey(st->city).compare(0, typed.size(), typed) != 0)
+                                label += u8" – " + st->name;   // dopasowanie po nazwie stacji
+                            if (ImGui::Selectable(label.c_str()))
+                                snprintf(cityBuf, IM_ARRAYSIZE(cityBuf), "%s", st->city.c_str());
+                        }
+                    }
                 }
                 else if (fetchMode == 2) {
                     ImGui::InputText("Adres", addrBuf, IM_ARRAYSIZE(addrBuf));
                     ImGui::SliderInt("Promień_(km)", &radiusKm, 1, 1000);
                 }
                 if (ImGui::Button("Pobierz dane")) {
-                    if (!is_fetching_stations) {
-                        is_fetching_stations = true;
-                        int current_mode = fetchMode;
-                        std::string current_city = cityBuf;
-                        std::string current_addr = addrBuf;
-                        int current_radius = radiusKm;
-
-                        stations_future = std::async(std::launch::async,
-                            [current_mode, current_city, current_addr, current_radius]() -> std::vector<Station> {  
-                                try {
-                                    if (current_mode == 0) return FetchAll();
-                                    else if (current_mode == 1) return FetchByCity(current_city);
-                                    else return FetchByRadius(current_addr, current_radius);
-                                }
-                                catch (...) {
-                                    return {};  // Zwróć pusty vector w przypadku błędu
-                                }
-                            }
-                        );
-                    }
+                    // Nowe żądanie zastępuje trwające: poprzednie jest anulowane, a jego wynik odrzucany
+                    stationsFetch.Cancel();
+                    stationsFetch = CancellationToken::Create();
+                    fetchingStations = true;
+                    int current_mode = fetchMode;
+                    std::string current_city = cityBuf;
+                    std::string current_addr = addrBuf;
+                    int current_radius = radiusKm;
+
+                    // Nowa wersja listy budowana jest w wątku pobierającym; UI tylko ją publikuje
+                    RunInBackground<StationFetchResult>(
+                        [current_mode, current_city, current_addr, current_radius]() {
+                            StationFetchResult r;
+                            if (current_mode == 0) r.snapshot = StationSnapshot::Build(StationCatalog::Refresh()->All());
+                            else if (current_mode == 1) r.snapshot = StationSnapshot::Build(FetchByCity(current_city));
+                            else r.snapshot = StationSnapshot::Build(FetchByRadius(current_addr, current_radius, &r.nearestOnly));
+                            return r;
+                        },
+                        [&](StationFetchResult result) {
+                            store.Publish(std::move(result.snapshot));
+                            stationsNearestOnly = result.nearestOnly;
+                            cityCatalog = StationCatalog::Get();   // po pełnym pobraniu – katalog odświeżony
+                            cancelStationFetches();
+                            dates.clear();
+                            selStation = -1;
+                            sensors.clear();
+                            selSensor = -1;
+                            data.clear();
+                            ++dataVersion;
+                            fetchedSeries.clear();
+                            fetchingStations = false;
+                            errorMsg = stationsNearestOnly ? u8"Brak stacji w promieniu – pokazano najbliższe stacje" : u8"Pobrano nowe dane!";
+                            showErrorPopup = true;
+                        },
+                        [&](const std::string& what) {
+                            fetchingStations = false;
+                            errorMsg = u8"Błąd sieciowy: " + what;
+                            showErrorPopup = true;
+                        },
+                        TaskPriority::High, stationsFetch);
                 }
 
                 // Wskaźnik ładowania
-                if (is_fetching_stations) {
+                if (fetchingStations) {
                     ImGui::SameLine();
                     // Animacja kropek przy ładowaniu
                     static int dotCount = 0;
@@ -963,16 +5283,21 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
             static bool showSaveDialog = false;
             static bool showLoadDialog = false;
             static char saveFilename[128] = "nowy_plik.json";
+            static bool saveBinary = false;
+            static bool saveRunning = false;
+            static float saveProgress = 0.0f;
             static std::vector<std::string> availableFiles;
 
             ImGui::Separator();
 
             // Zapis danych lokalnych
-            if (ImGui::Button("Zapisz lokalnie")) {
-                if (selStation >= 0) {
-                    std::lock_guard<std::mutex> lock(stations_mutex);
+            if (saveRunning) {
+                ImGui::ProgressBar(saveProgress, ImVec2(-1, 0), u8"Zapisywanie...");
+            }
+            else if (ImGui::Button("Zapisz lokalnie")) {
+                if (selStation >= 0 && selStation < static_cast<int>(snap->Size())) {
                     showSaveDialog = true;
-                    auto& s = stations[selStation];
+                    const Station& s = (*snap)[selStation];
                     auto t = system_clock::now();
                     std::time_t tt = system_clock::to_time_t(t);
                     std::tm tm;
@@ -980,28 +5305,58 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
                     char buf[64];
                     strftime(buf, sizeof(buf), "%Y%m%d_%H%M%S", &tm);
                     snprintf(saveFilename, IM_ARRAYSIZE(saveFilename),
-                        "station_%d_%s.json", s.id, buf);
+                        "station_%d_%s%s", s.id, buf, saveBinary ? ".aqb" : ".json");
                     ImGui::OpenPopup("Zapisz plik");
                 }
             }
             if (ImGui::BeginPopupModal("Zapisz plik", &showSaveDialog, ImGuiWindowFlags_AlwaysAutoResize)) {
                 ImGui::Text("Nazwa pliku:");
                 ImGui::InputText("##save_name", saveFilename, IM_ARRAYSIZE(saveFilename));
-                if (ImGui::Button("Zapisz")) {
-                    try {
-                        std::string filename(saveFilename);
-                        if (filename.find(".json") == std::string::npos) {
-                            filename += ".json";
+                ImGui::Checkbox("Format binarny (.aqb)", &saveBinary);
+                if (ImGui::Button("Zapisz") && selStation >= 0 && selStation < static_cast<int>(snap->Size())) {
+                    std::string filename(saveFilename);
+                    const char* ext = saveBinary ? ".aqb" : ".json";
+                    if (HasExtension(filename, ".json") || HasExtension(filename, ".aqb")) {
+                        filename.erase(filename.rfind('.'));
+                    }
+                    filename += ext;
+
+                    Station snapshot = (*snap)[selStation];
+                    SaveCallbacks saveCallbacks;
+                    saveCallbacks.onProgress = [&](size_t done, size_t total) {
+                        saveProgress = static_cast<float>(done) / total;
+                        };
+                    saveCallbacks.onSeries = [&](int stationId, int sensorId, const Series& series) {
+                        // Kopia stacji powstaje tylko wtedy, gdy seria rzeczywiście uzupełnia dane
+                        auto current = store.Current();
+                        const int pos = current->Find(stationId);
+                        if (pos < 0) return;
+                        const SensorSeries* known = (*current)[pos].sensors.Find(sensorId);
+                        if (known && !known->Empty()) return;
+                        store.Update(stationId, [&](Station& s) {
+                            SensorSeries& target = s.sensors.At(sensorId);
+                            if (target.Empty()) target.Assign(series);
+                            });
+                        };
+                    saveCallbacks.onDone = [&](const std::string& fn, const std::vector<std::pair<int, std::string>>& failed) {
+                        saveRunning = false;
+                        errorMsg = u8"Zapisano dane jako: " + fn;
+                        if (!failed.empty()) {
+                            errorMsg += u8"\nBez danych sensorów (błąd pobierania):";
+                            for (const auto& [sensorId, what] : failed)
+                                errorMsg += "\n  " + std::to_string(sensorId) + ": " + what;
                         }
-                        SaveDB(filename, dates, stations[selStation]);
-                        errorMsg = u8"Zapisano dane jako: " + filename;
                         showErrorPopup = true;
-                        showSaveDialog = false;
-                    }
-                    catch (const std::exception& e) {
-                        errorMsg = u8"Błąd zapisu: " + std::string(e.what());
+                        };
+                    saveCallbacks.onError = [&](const std::string& what) {
+                        saveRunning = false;
+                        errorMsg = u8"Błąd zapisu: " + what;
                         showErrorPopup = true;
-                    }
+                        };
+                    saveRunning = true;
+                    saveProgress = 0.0f;
+                    SaveDBAsync(filename, dates, std::move(snapshot), saveBinary, std::move(saveCallbacks));
+                    showSaveDialog = false;
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Anuluj")) {
@@ -1010,19 +5365,29 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
                 ImGui::EndPopup();
             }
 
+            // Dziennik przyrostowy: po włączeniu dopisywane są tylko nowe próbki pobranych serii
+            if (ImGui::Checkbox("Dziennik przyrostowy", &journalEnabled) && journalEnabled
+                && selStation >= 0 && selStation < static_cast<int>(snap->Size())) {
+                SeriesJournal::Instance().WriteMeta((*snap)[selStation]);
+            }
+
             // Wczytanie danych lokalnych
             if (ImGui::Button("Wczytaj dane lokalne")) {
                 availableFiles.clear();
                 WIN32_FIND_DATAA findData;
-                HANDLE hFind = FindFirstFileA("savefiles\\*.json", &findData);
-                if (hFind != INVALID_HANDLE_VALUE) {
-                    do {
-                        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
-                            availableFiles.push_back(findData.cFileName);
-                        }
-                    } while (FindNextFileA(hFind, &findData));
-                    FindClose(hFind);
+                for (const char* pattern : { "savefiles\\*.json", "savefiles\\*.aqb" }) {
+                    HANDLE hFind = FindFirstFileA(pattern, &findData);
+                    if (hFind != INVALID_HANDLE_VALUE) {
+                        do {
+                            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                                availableFiles.push_back(findData.cFileName);
+                            }
+                        } while (FindNextFileA(hFind, &findData));
+                        FindClose(hFind);
+                    }
                 }
+                for (int id : SeriesJournal::Instance().Stations())
+                    availableFiles.push_back("dziennik/" + std::to_string(id));
                 showLoadDialog = true;
                 ImGui::OpenPopup("Wybierz plik");
             }
@@ -1040,13 +5405,17 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
                 if (ImGui::Button("Wczytaj")) {
                     if (selectedFile >= 0) {
                         Station loadedStation;
-                        if (LoadDB(availableFiles[selectedFile], dates, loadedStation)) {
-                            auto it = std::find_if(stations.begin(), stations.end(),
-                                [&](const Station& s) { return s.id == loadedStation.id; });
-                            if (it != stations.end())
-                                *it = loadedStation;
-                            else
-                                stations.push_back(loadedStation);
+                        const std::string& file = availableFiles[selectedFile];
+                        bool loaded;
+                        if (file.rfind("dziennik/", 0) == 0)
+                            loaded = SeriesJournal::Instance().Load(std::stoi(file.substr(9)), loadedStation, dates);
+                        else if (HasExtension(file, ".aqb"))
+                            loaded = LoadDBBinary(file, dates, loadedStation);
+                        else
+                            loaded = LoadDB(file, dates, loadedStation);
+                        if (loaded) {
+                            store.Upsert(std::move(loadedStation));
+                            stationsNearestOnly = false;
                         }
                     }
                 }
@@ -1057,20 +5426,142 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
                 ImGui::EndPopup();
             }
 
+            // Archiwum dziennych migawek (stations_db.json / of_stations_db.json)
+            static bool showArchiveDialog = false;
+            if (ImGui::Button("Archiwum migawek")) {
+                showArchiveDialog = true;
+                ImGui::OpenPopup("Archiwum migawek");
+                if (!archive && !loadingArchive) {
+                    loadingArchive = true;
+                    // Nazwy parametrów sensorów: z bieżącej migawki stacji i z metadanych dziennika
+                    std::unordered_map<int, std::string> sensorParams;
+                    if (auto snap = store.Current()) {
+                        for (const auto& s : snap->stations)
+                            for (size_t i = 0; i < s->sensors.Size(); ++i)
+                                sensorParams[s->sensors.IdAt(i)] = s->sensors.NameAt(i);
+                    }
+                    RunInBackground<std::shared_ptr<const SnapshotArchive>>(
+                        [sensorParams = std::move(sensorParams)]() mutable {
+                            for (auto& [id, name] : SeriesJournal::Instance().SensorNames())
+                                sensorParams.emplace(id, std::move(name));
+                            return SnapshotArchive::FromFiles({ "stations_db.json", "of_stations_db.json" }, sensorParams);
+                        },
+                        [&](std::shared_ptr<const SnapshotArchive> loaded) {
+                            archive = std::move(loaded);
+                            loadingArchive = false;
+                        },
+                        [&](const std::string& what) {
+                            loadingArchive = false;
+                            errorMsg = u8"Błąd wczytywania archiwum: " + what;
+                            showErrorPopup = true;
+                        });
+                }
+            }
+            if (ImGui::BeginPopupModal("Archiwum migawek", &showArchiveDialog, ImGuiWindowFlags_AlwaysAutoResize)) {
+                if (!archive) {
+                    ImGui::Text("Wczytywanie archiwum...");
+                }
+                else if (archive->Dates().empty()) {
+                    ImGui::Text("Brak danych w archiwum");
+                }
+                else {
+                    static int archiveDate = 0, archiveFrom = 0, archiveTo = 0, archiveRegion = 0, archiveParam = 0, topN = 10;
+                    const auto& archiveDates = archive->Dates();
+                    const auto& archiveRegions = archive->Regions();
+                    const auto& archiveParams = archive->Parameters();
+                    const int lastDate = static_cast<int>(archiveDates.size()) - 1;
+                    archiveDate = std::clamp(archiveDate, 0, lastDate);
+                    archiveFrom = std::clamp(archiveFrom, 0, lastDate);
+                    archiveTo = std::clamp(archiveTo, archiveFrom, lastDate);
+
+                    ImGui::Text("Najgorsze stacje dnia:");
+                    ImGui::SliderInt("Dzień", &archiveDate, 0, lastDate, archiveDates[archiveDate].c_str());
+                    ImGui::SliderInt("Liczba stacji", &topN, 1, 20);
+                    for (const auto& r : archive->WorstStations(archiveDates[archiveDate], topN)) {
+                        ImGui::Text("%8.1f  %s [%s]", r.index, r.name.c_str(), r.region.c_str());
+                    }
+
+                    ImGui::Separator();
+                    ImGui::Text("Indeks województwa:");
+                    if (ImGui::BeginListBox("##ArchiveRegions", ImVec2(-1, 120))) {
+                        for (int i = 0; i < static_cast<int>(archiveRegions.size()); ++i) {
+                            if (ImGui::Selectable(archiveRegions[i].c_str(), archiveRegion == i)) {
+                                archiveRegion = i;
+                            }
+                        }
+                        ImGui::EndListBox();
+                    }
+                    ImGui::SliderInt("Od", &archiveFrom, 0, lastDate, archiveDates[archiveFrom].c_str());
+                    ImGui::SliderInt("Do", &archiveTo, archiveFrom, lastDate, archiveDates[archiveTo].c_str());
+                    if (archiveRegion < static_cast<int>(archiveRegions.size())) {
+                        auto points = archive->RegionIndex(archiveRegions[archiveRegion], archiveDates[archiveFrom], archiveDates[archiveTo]);
+                        std::vector<double> x_vals, y_vals;
+                        std::vector<const char*> labels;
+                        for (size_t i = 0; i < points.size(); ++i) {
+                            x_vals.push_back(static_cast<double>(i));
+                            y_vals.push_back(points[i].mean);
+                            labels.push_back(points[i].date.c_str());
+                        }
+                        if (!archiveParams.empty()) {
+                            archiveParam = std::clamp(archiveParam, 0, static_cast<int>(archiveParams.size()) - 1);
+                            ImGui::Text("Stężenia parametru:");
+                            if (ImGui::BeginListBox("##ArchiveParams", ImVec2(-1, 80))) {
+                                for (int i = 0; i < static_cast<int>(archiveParams.size()); ++i) {
+                                    if (ImGui::Selectable(archiveParams[i].c_str(), archiveParam == i))
+                                        archiveParam = i;
+                                }
+                                ImGui::EndListBox();
+                            }
+                            // Szkic scalany tylko po zmianie archiwum lub wyboru, nie w każdej klatce
+                            static const SnapshotArchive* quantilesArchive = nullptr;
+                            static std::array<int, 4> quantilesKey{ -1, -1, -1, -1 };
+                            static QuantileSketch regionQuantiles;
+                            const std::array<int, 4> key{ archiveRegion, archiveParam, archiveFrom, archiveTo };
+                            if (quantilesArchive != archive.get() || quantilesKey != key) {
+                                regionQuantiles = archive->RegionQuantiles(archiveRegions[archiveRegion], archiveParams[archiveParam],
+                                    archiveDates[archiveFrom], archiveDates[archiveTo]);
+                                quantilesArchive = archive.get();
+                                quantilesKey = key;
+                            }
+                            const QuantileSketch& q = regionQuantiles;
+                            if (!q.Empty()) {
+                                ImGui::Text("P50: %.1f  P95: %.1f  P98: %.1f (%zu pomiarów)", q.Quantile(0.50), q.Quantile(0.95), q.Quantile(0.98), q.Count());
+                            }
+                        }
+                        if (!points.empty() && ImPlot::BeginPlot("##ArchiveRegionChart", ImVec2(500, 250))) {
+                            PrepareAdaptiveTicksX(static_cast<int>(points.size()), labels);
+                            ImPlot::SetupAxes("Dzień", "Średni indeks", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+                            ImPlot::PlotLine("##RegionMean", x_vals.data(), y_vals.data(), static_cast<int>(points.size()));
+                            ImPlot::EndPlot();
+                        }
+                    }
+                }
+                if (ImGui::Button("Zamknij")) {
+                    showArchiveDialog = false;
+                }
+                ImGui::EndPopup();
+            }
+
             ImGui::Separator();
-            ImGui::Text("Lista stacji:");
-            std::lock_guard<std::mutex> lock(stations_mutex);
+            ImGui::Text("Lista stacji (%zu/%zu):", stationList.VisibleCount(), stationList.TotalCount());
+            if (stationsNearestOnly)
+                ImGui::TextColored(ImVec4(1, 0.8f, 0.3f, 1), u8"brak stacji w promieniu – najbliższe stacje");
+            if (ImGui::InputText("Filtr", stationFilter, IM_ARRAYSIZE(stationFilter)))
+                stationList.SetFilter(stationFilter);
+            const char* sortNames[] = { u8"Kolejność pobrania", "Nazwa", "Indeks malejąco" };
+            if (ImGui::Combo("Sortuj", &stationSort, sortNames, IM_ARRAYSIZE(sortNames)))
+                stationList.SetSort(stationSort);
+            // Lista korzysta wyłącznie z etykiet modelu zsynchronizowanego na początku klatki
             if (ImGui::BeginListBox("##StationsList", ImVec2(-1, -1))) {
-                for (int i = 0; i < static_cast<int>(stations.size()); ++i) {
-                    const auto& s = stations[i];
-                    char buf[128];
-                    sprintf_s(buf, "%s [%s] - %.1f", s.name.c_str(), s.city.c_str(), s.latest());
-                    if (ImGui::Selectable(buf, selStation == i)) {
-                        selStation = i;
-                        sensors.clear();
-                        selSensor = -1;
-                        data.clear();
-                    }
+                const int clicked = stationList.Draw(selStation);
+                if (clicked >= 0) {
+                    cancelStationFetches();
+                    selStation = clicked;
+                    sensors.clear();
+                    selSensor = -1;
+                    data.clear();
+                    ++dataVersion;
+                    fetchedSeries.clear();
                 }
                 ImGui::EndListBox();
             }
@@ -1079,8 +5570,8 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
             // Panel szczegółów po prawej stronie
             ImGui::SameLine();
             ImGui::BeginChild("DetailsPanel", ImVec2(0, 0), true);
-            if (selStation >= 0 && selStation < static_cast<int>(stations.size())) {
-                auto& station = stations[selStation];
+            if (selStation >= 0 && selStation < static_cast<int>(snap->Size())) {
+                const Station& station = (*snap)[selStation];
                 ImGui::Text("Stacja: %s", station.name.c_str());
                 ImGui::Text("Lokalizacja: %s, %s", station.city.c_str(), station.region.c_str());
 
@@ -1096,49 +5587,44 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
                 if (sensors.empty()) {
                     if (ImGui::Button("Pobierz sensory")) {
                         if (!onlineMode) {
-                            for (const auto& [sensor_id, hist] : station.sensor_history) {
-                                if (station.sensor_names.count(sensor_id)) {
-                                    const auto& name = station.sensor_names.at(sensor_id);
-                                    if (!hist.empty()) {
-                                        sensors.push_back({ sensor_id, name });
-                                    }
+                            for (size_t i = 0; i < station.sensors.Size(); ++i) {
+                                const auto& name = station.sensors.NameAt(i);
+                                if (!name.empty() && !station.sensors.SeriesAt(i).Empty()) {
+                                    sensors.push_back({ station.sensors.IdAt(i), name });
                                 }
                             }
                         }
-                        else {
-                            try {
-                                sensors = FetchSensors(station.id);
-                                for (const auto& sensor : sensors) {
-                                    station.sensor_names[sensor.id] = sensor.name;
-                                    if (station.sensor_history[sensor.id].empty()) {
-                                        station.sensor_history[sensor.id] = {};
-                                    }
-                                }
-                            }
-                            catch (const NetworkException& e) {
-                                errorMsg = u8"Błąd sieciowy: " + std::string(e.what());
-                                showErrorPopup = true;
-                                onlineMode = false;
-                                if (!station.sensor_history.empty()) {
-                                    sensors.clear();
-                                    for (const auto& [sensor_id, values] : station.sensor_history) {
-                                        if (!values.empty()) {
-                                            sensors.push_back({ sensor_id, "Sensor #" + std::to_string(sensor_id) + " (" + std::to_string(values.size()) + " rekordów)" });
-                                        }
-                                    }
-                                }
-                            }
+                        else if (pendingSensorFetches == 0) {
+                            // Sensory i dane wszystkich sensorów pobierane są równolegle w tle
+                            pendingSensorFetches = 1;
+                            sensorsFetch = CancellationToken::Create();
+                            fetchEngine.FetchStation(station.id, sensorCallbacks, sensorsFetch);
                         }
                     }
+                    if (pendingSensorFetches > 0) {
+                        ImGui::SameLine();
+                        ImGui::Text(u8"Pobieranie sensorów...");
+                    }
                 }
                 else {
                     ImGui::Separator();
                     ImGui::Text("sensory:");
+                    if (pendingSensorFetches > 0) {
+                        ImGui::SameLine();
+                        ImGui::TextDisabled(u8"(pobieranie danych: %d)", pendingSensorFetches);
+                    }
                     if (ImGui::BeginListBox("##SensorsList", ImVec2(-1, 100))) {
                         for (int i = 0; i < static_cast<int>(sensors.size()); ++i) {
                             if (ImGui::Selectable(sensors[i].name.c_str(), selSensor == i)) {
+                                // Pobieranie serii poprzednio wybranego sensora nie jest już potrzebne
+                                if (seriesFetchSensor >= 0 && seriesFetchSensor != sensors[i].id) {
+                                    seriesFetch.Cancel();
+                                    seriesFetchSensor = -1;
+                                    pendingSensorFetches = 0;
+                                }
                                 selSensor = i;
                                 data.clear();
+                                ++dataVersion;
                             }
                         }
                         ImGui::EndListBox();
@@ -1151,94 +5637,33 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
                     if (data.empty()) {
                         if (ImGui::Button("Pobierz dane historyczne")) {
                             if (!onlineMode) {
-                                if (station.sensor_history.count(sensor.id) > 0) {
-                                    const auto& hist = station.sensor_history.at(sensor.id);
-                                    data.clear();
-                                    for (size_t i = 0; i < hist.size(); ++i) {
-                                        data.emplace_back(system_clock::now() - hours(24 * i), hist.at(i));
-                                    }
-                                    analysis = Analyze(data);
+                                const SensorSeries* hist = station.sensors.Find(sensor.id);
+                                if (hist && !hist->Empty()) {
+                                    data = hist->ToPoints();
+                                    ++dataVersion;
+                                    analysis = Summarize(hist->Stats());
+                                    seriesQuantiles = hist->Sketch();
+                                    seriesQuantiles.Compress();
                                 }
                             }
                             else {
-                                try {
-                                    auto j = FetchData(sensor.id);
-                                    data.clear();
-                                    for (const auto& entry : j["values"]) {
-                                        if (entry["value"].is_null()) {
-                                            continue;
-                                        }
-                                        std::string date_str = entry["date"].get<std::string>();
-                                        std::tm tm = {};
-                                        std::istringstream ss(date_str);
-                                        ss >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
-                                        if (ss.fail()) {
-                                            continue;
-                                        }
-                                        tm.tm_isdst = -1;
-                                        time_t time = std::mktime(&tm);
-                                        if (time == -1) {
-                                            continue;
-                                        }
-                                        auto tp = system_clock::from_time_t(time);
-                                        double value = entry["value"].get<double>();
-                                        data.emplace_back(tp, value);
-                                    }
-                                    std::sort(data.begin(), data.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
-                                    station.sensor_history[sensor.id] = std::vector<double>();
-                                    auto& hist = station.sensor_history[sensor.id];
-                                    for (const auto& d : data) {
-                                        hist.push_back(d.second);
-                                    }
-                                    if (hist.size() > days) {
-                                        hist.erase(hist.begin(), hist.end() - days);
-                                    }
-                                    if (days > 0 && data.size() > days) {
-                                        data.erase(data.begin(), data.end() - days);
-                                    }
-                                    if (!data.empty()) {
-                                        time_t last_time = system_clock::to_time_t(data.back().first);
-                                        std::tm last_tm;
-                                        localtime_s(&last_tm, &last_time);
-                                        char buf[64];
-                                        strftime(buf, sizeof(buf), "%Y-%m-%d %H", &last_tm);
-                                        dates.push_back(buf);
-                                        double sum = 0.0;
-                                        int count = 0;
-                                        for (const auto& d : data) {
-                                            sum += d.second;
-                                            count++;
-                                        }
-                                        station.history.push_back(sum / count);
-                                        auto& sensor_data = station.sensor_history[sensor.id];
-                                        sensor_data.clear();
-                                        for (const auto& d : data) {
-                                            sensor_data.push_back(d.second);
-                                        }
-                                        if (days > 0 && sensor_data.size() > days) {
-                                            sensor_data.erase(sensor_data.begin(), sensor_data.end() - days);
-                                        }
-                                        if (!data.empty()) {
-                                            analysis = Analyze(data);
-                                            days = std::min(50, static_cast<int>(data.size()));
-                                        }
-                                        else {
-                                            errorMsg = u8"Brak danych do analizy";
-                                            showErrorPopup = true;
-                                        }
-                                    }
-                                    else {
-                                        errorMsg = u8"Brak prawidłowych danych do wyświetlenia";
-                                        showErrorPopup = true;
-                                    }
+                                auto it = fetchedSeries.find(sensor.id);
+                                if (it != fetchedSeries.end()) {
+                                    applySeries(station.id, sensor.id, it->second);
                                 }
-                                catch (const NetworkException& e) {
-                                    errorMsg = u8"Błąd pobierania: " + std::string(e.what());
-                                    showErrorPopup = true;
-                                    onlineMode = false;
+                                else if (pendingSensorFetches == 0) {
+                                    // Seria nie została jeszcze pobrana w tle – pobierz tylko ten sensor
+                                    pendingSensorFetches = 1;
+                                    seriesFetch = CancellationToken::Create();
+                                    seriesFetchSensor = sensor.id;
+                                    fetchEngine.FetchSeries(station.id, { sensor.id }, sensorCallbacks, seriesFetch);
                                 }
                             }
                         }
+                        if (pendingSensorFetches > 0 && !fetchedSeries.count(sensor.id)) {
+                            ImGui::SameLine();
+                            ImGui::Text(u8"Ładowanie...");
+                        }
                     }
                     else {
                         ImGui::Separator();
@@ -1247,45 +5672,26 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
                         ImGui::Text("Max: %.2f (%s)", analysis.max, analysis.maxT.c_str());
                         ImGui::Text("Średnia: %.2f", analysis.avg);
                         ImGui::Text("Trend: %.2f jednostek/dzień", analysis.trend);
+                        if (!seriesQuantiles.Empty()) {
+                            const QuantileSketch& q = seriesQuantiles;
+                            ImGui::Text("P50: %.2f  P95: %.2f  P98: %.2f (cała seria)", q.Quantile(0.50), q.Quantile(0.95), q.Quantile(0.98));
+                        }
                         ImGui::Separator();
-                        int maxDays = std::min(static_cast<int>(data.size()), 50);
+                        int maxDays = std::max(2, static_cast<int>(data.size()));
                         ImGui::SliderInt("Okres (dni)", &days, 2, maxDays);
                         ImGui::RadioButton("Wykres liniowy", &plotType, 0);
                         ImGui::SameLine();
                         ImGui::RadioButton("Wykres słupkowy", &plotType, 1);
-                        if (selSensor >= 0 && !data.empty() && days > 0) {
-                            std::vector<double> x_vals;
-                            std::vector<double> y_vals;
-                            std::vector<std::string> labels_str;
-                            std::vector<const char*> labels;
-                            const int total_points = static_cast<int>(data.size());
-                            const int points_to_show = std::min(days, total_points);
-                            const int start_idx = total_points - points_to_show;
-                            for (int i = 0; i < points_to_show; ++i) {
-                                const auto& point = data[start_idx + i];
-                                x_vals.push_back(i);
-                                y_vals.push_back(point.second);
-                                time_t t = system_clock::to_time_t(point.first);
-                                struct tm tm_time;
-                                localtime_s(&tm_time, &t);
-                                char buf[32];
-                                strftime(buf, sizeof(buf), "%d/%m %H:%M", &tm_time);
-                                labels_str.push_back(buf);
-                            }
-                            for (const auto& str : labels_str) {
-                                labels.push_back(str.c_str());
-                            }
-                            if (ImPlot::BeginPlot("##HistoryChart", ImVec2(-1, 300))) {
-                                PrepareAdaptiveTicksX(points_to_show, labels);
-                                ImPlot::SetupAxes("Data", "Wartość", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
-                                if (plotType == 0) {
-                                    ImPlot::PlotLine("##Series", x_vals.data(), y_vals.data(), points_to_show);
-                                }
-                                else {
-                                    ImPlot::PlotBars("##Bars", x_vals.data(), y_vals.data(), points_to_show, 0.7);
-                                }
-                                ImPlot::EndPlot();
-                            }
+                        static bool showMa8 = false, showMa24 = false;
+                        ImGui::Checkbox("Średnia 8h", &showMa8);
+                        ImGui::SameLine();
+                        ImGui::Checkbox("Średnia 24h", &showMa24);
+
+                        // Model wykresu przeliczany tylko po zmianie danych, okresu, typu wykresu lub szerokości
+                        static HistoryChartModel historyChart;
+                        if (selSensor >= 0) {
+                            historyChart.Update(data, dataVersion, days, plotType, showMa8, showMa24, static_cast<int>(ImGui::GetContentRegionAvail().x));
+                            historyChart.Draw();
                         }
                     }
                 }
@@ -1301,9 +5707,19 @@ int WINAPI _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdL
         g_pd3dDeviceContext->ClearRenderTargetView(g_mainRTV, clear_color);
         ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
         g_pSwapChain->Present(1, 0);
+
+        // Przeciągany suwak, pole tekstowe z migającym kursorem itp. wymagają ciągłego odświeżania
+        if (ImGui::IsAnyItemActive() || ImGui::GetIO().WantTextInput)
+            activeUntil = steady_clock::now() + kActiveWindow;
     }
 
-    // Czyszczenie zasobów i zamknięcie aplikacji
+    // Czyszczenie zasobów i zamknięcie aplikacji: przerwanie trwających pobrań, zapis dziennika
+    // i zatrzymanie puli, zanim zostaną zniszczone singletony, których używają jej zadania
+    stationsFetch.Cancel();
+    sensorsFetch.Cancel();
+    seriesFetch.Cancel();
+    SeriesJournal::Instance().Flush();
+    TaskScheduler::Instance().Shutdown();
     ImGui_ImplDX11_Shutdown();
     ImGui_ImplWin32_Shutdown();
     ImPlot::DestroyContext();